@@ -29,7 +29,9 @@ namespace ACSVM
       argV  {std::move(a.argV)},
       id    {std::move(a.id)},
       link  {this, std::move(a.link)},
-      name  {std::move(a.name)}
+      name  {std::move(a.name)},
+
+      queueNext{nullptr}
    {
    }
 
@@ -41,7 +43,9 @@ namespace ACSVM
       argV  {std::move(argV_)},
       id    {id_},
       link  {this},
-      name  {name_}
+      name  {name_},
+
+      queueNext{nullptr}
    {
    }
 
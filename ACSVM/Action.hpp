@@ -76,6 +76,8 @@ namespace ACSVM
       ScopeID                id;
       ListLink<ScriptAction> link;
       ScriptName             name;
+
+      ScriptAction *queueNext; // Link in Environment's action queue.
    };
 }
 
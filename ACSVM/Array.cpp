@@ -16,6 +16,116 @@
 #include "Environment.hpp"
 #include "Serial.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+
+//----------------------------------------------------------------------------|
+// Types                                                                      |
+//
+
+namespace ACSVM
+{
+   //
+   // ArrayNodeCache
+   //
+   // Freed Array nodes of one size, kept for reuse. Each host thread has its
+   // own, so nodes are taken and returned without locking. Cached nodes are
+   // linked through their first word.
+   //
+   // Trivially destructible, so that it stays usable by Arrays destructed
+   // after the thread's other thread_local objects.
+   //
+   class ArrayNodeCache
+   {
+   public:
+      //
+      // alloc
+      //
+      void *alloc(std::size_t size)
+      {
+         void *node = head;
+
+         if(node)
+         {
+            head = *static_cast<void **>(node);
+            --count;
+         }
+         else
+            node = ::operator new(size);
+
+         return std::memset(node, 0, size);
+      }
+
+      //
+      // free
+      //
+      void free(void *node)
+      {
+         if(count == CountMax)
+            return ::operator delete(node);
+
+         *static_cast<void **>(node) = head;
+         head = node;
+         ++count;
+      }
+
+      //
+      // release
+      //
+      void release()
+      {
+         while(head)
+         {
+            void *next = *static_cast<void **>(head);
+            ::operator delete(head);
+            head = next;
+         }
+
+         count = 0;
+      }
+
+      // Limits the memory held by each thread after many arrays are freed,
+      // such as when a MapScope is reset.
+      static constexpr std::size_t CountMax = 1024;
+
+      void       *head;
+      std::size_t count;
+   };
+
+   //
+   // ArrayNodeCacheRelease
+   //
+   // Frees the calling thread's cached nodes when the thread exits.
+   //
+   class ArrayNodeCacheRelease
+   {
+   public:
+      ~ArrayNodeCacheRelease();
+   };
+
+   //
+   // ArrayNodeCacheState
+   //
+   enum class ArrayNodeCacheState
+   {
+      Unused, // Nothing cached yet, release not yet arranged.
+      Active, // Release arranged for thread exit.
+      Closed, // Thread is exiting, nodes are no longer cached.
+   };
+}
+
+
+//----------------------------------------------------------------------------|
+// Static Objects                                                             |
+//
+
+namespace ACSVM
+{
+   static thread_local ArrayNodeCacheState NodeCacheState;
+}
+
 
 //----------------------------------------------------------------------------|
 // Static Functions                                                           |
@@ -23,6 +133,49 @@
 
 namespace ACSVM
 {
+   //
+   // GetNodeCache
+   //
+   // Zero-initialized, without a destructor, so it is always safe to use.
+   //
+   template<std::size_t Size>
+   static ArrayNodeCache &GetNodeCache()
+   {
+      static thread_local ArrayNodeCache cache;
+      return cache;
+   }
+
+   //
+   // UseNodeCache
+   //
+   // Returns true if freed nodes may be cached by the calling thread,
+   // arranging for them to be released when it exits.
+   //
+   static bool UseNodeCache()
+   {
+      if(NodeCacheState == ArrayNodeCacheState::Unused)
+      {
+         static thread_local ArrayNodeCacheRelease release;
+         (void)release;
+
+         NodeCacheState = ArrayNodeCacheState::Active;
+      }
+
+      return NodeCacheState == ArrayNodeCacheState::Active;
+   }
+
+   //
+   // AllocNode
+   //
+   // Page, Segm, Bank and Data are arrays of trivial types, for which zeroed
+   // storage is the value-initialized state.
+   //
+   template<typename T>
+   static T *AllocNode()
+   {
+      return static_cast<T *>(GetNodeCache<sizeof(T)>().alloc(sizeof(T)));
+   }
+
    //
    // FreeData (Word)
    //
@@ -41,7 +194,11 @@ namespace ACSVM
       for(auto &itr : *data)
          FreeData(itr);
 
-      delete[] data;
+      if(UseNodeCache())
+         GetNodeCache<sizeof(T)>().free(data);
+      else
+         ::operator delete(data);
+
       data = nullptr;
    }
 
@@ -61,7 +218,7 @@ namespace ACSVM
    {
       if(in.get())
       {
-         if(!out) out = new T[1]{};
+         if(!out) out = AllocNode<T>();
 
          for(auto &itr : *out)
             ReadData(in, itr);
@@ -122,27 +279,32 @@ namespace ACSVM
 namespace ACSVM
 {
    //
-   // Array::operator [Word]
+   // ArrayNodeCacheRelease destructor
    //
-   Word &Array::operator [] (Word idx)
+   ArrayNodeCacheRelease::~ArrayNodeCacheRelease()
    {
-      if(!data) data = new Data[1]{};
-      Bank *&bank = (*data)[idx / (BankSize * SegmSize * PageSize)];
+      NodeCacheState = ArrayNodeCacheState::Closed;
+      Array::FreeCache();
+   }
 
-      if(!bank) bank = new Bank[1]{};
-      Segm *&segm = (*bank)[idx / (SegmSize * PageSize) % BankSize];
+   //
+   // Array::clear
+   //
+   void Array::clear()
+   {
+      FreeData(data);
+      pageIdx = PageIdxNone;
 
-      if(!segm) segm = new Segm[1]{};
-      Page *&page = (*segm)[idx / PageSize % SegmSize];
+      freeDense();
 
-      if(!page) page = new Page[1]{};
-      return (*page)[idx % PageSize];
+      shared  = nullptr;
+      sharedC = 0;
    }
 
    //
-   // Array::find
+   // Array::findPage
    //
-   Word Array::find(Word idx) const
+   Word Array::findPage(Word idx) const
    {
       if(!data) return 0;
       Bank *&bank = (*data)[idx / (BankSize * SegmSize * PageSize)];
@@ -151,18 +313,69 @@ namespace ACSVM
       Segm *&segm = (*bank)[idx / (SegmSize * PageSize) % BankSize];
 
       if(!segm) return 0;
-      Page *&page = (*segm)[idx / PageSize % SegmSize];
+      Page *&pageFound = (*segm)[idx / PageSize % SegmSize];
 
-      if(!page) return 0;
+      if(!pageFound) return 0;
+      page    = pageFound;
+      pageIdx = idx / PageSize;
       return (*page)[idx % PageSize];
    }
 
    //
-   // Array::clear
+   // Array::FreeCache
    //
-   void Array::clear()
+   void Array::FreeCache()
    {
-      FreeData(data);
+      GetNodeCache<sizeof(Page)>().release();
+      GetNodeCache<sizeof(Segm)>().release();
+      GetNodeCache<sizeof(Bank)>().release();
+      GetNodeCache<sizeof(Data)>().release();
+   }
+
+   //
+   // Array::freeDense
+   //
+   void Array::freeDense()
+   {
+      if(denseOwn)
+         delete[] dense;
+
+      dense    = nullptr;
+      denseC   = 0;
+      denseOwn = false;
+   }
+
+   //
+   // Array::getPage
+   //
+   Array::Page &Array::getPage(Word idx)
+   {
+      if(denseC) moveDense();
+
+      if(!data) data = AllocNode<Data>();
+      Bank *&bank = (*data)[idx / (BankSize * SegmSize * PageSize)];
+
+      if(!bank) bank = AllocNode<Bank>();
+      Segm *&segm = (*bank)[idx / (SegmSize * PageSize) % BankSize];
+
+      if(!segm) segm = AllocNode<Segm>();
+      Page *&pageFound = (*segm)[idx / PageSize % SegmSize];
+
+      if(!pageFound) pageFound = AllocNode<Page>();
+      page    = pageFound;
+      pageIdx = idx / PageSize;
+      return *page;
+   }
+
+   //
+   // Array::getWord
+   //
+   Word &Array::getWord(Word idx)
+   {
+      if(sharedC) unshare();
+
+      if(idx < denseC) return dense[idx];
+      return getPage(idx)[idx % PageSize];
    }
 
    //
@@ -170,6 +383,14 @@ namespace ACSVM
    //
    void Array::loadState(Serial &in)
    {
+      // Reading may free pages.
+      pageIdx = PageIdxNone;
+
+      freeDense();
+
+      shared  = nullptr;
+      sharedC = 0;
+
       in.readSign(Signature::Array);
       ReadData(in, data);
       in.readSign(~Signature::Array);
@@ -180,34 +401,167 @@ namespace ACSVM
    //
    void Array::lockStrings(Environment *env) const
    {
+      for(Word i = 0; i != denseC; ++i)
+         RefStringsData(env, dense[i], [](String *s){++s->lock;});
+
+      for(Word i = 0; i != sharedC; ++i)
+         RefStringsData(env, shared[i], [](String *s){++s->lock;});
+
       RefStringsData(env, data, [](String *s){++s->lock;});
    }
 
+   //
+   // Array::moveDense
+   //
+   // Moves words from dense storage into pages, for a write past its end.
+   //
+   void Array::moveDense()
+   {
+      Word denseOldC = denseC;
+
+      // Clearing denseC makes operator [] allocate pages, and stops getPage
+      // from calling back into this.
+      denseC = 0;
+
+      try
+      {
+         for(Word i = 0; i != denseOldC; ++i)
+            if(dense[i]) (*this)[i] = dense[i];
+      }
+      catch(...)
+      {
+         denseC = denseOldC;
+         throw;
+      }
+
+      freeDense();
+   }
+
    //
    // Array::refStrings
    //
    void Array::refStrings(Environment *env) const
    {
+      for(Word i = 0; i != denseC; ++i)
+         RefStringsData(env, dense[i], [](String *s){s->ref = true;});
+
+      for(Word i = 0; i != sharedC; ++i)
+         RefStringsData(env, shared[i], [](String *s){s->ref = true;});
+
       RefStringsData(env, data, [](String *s){s->ref = true;});
    }
 
+   //
+   // Array::reserve
+   //
+   void Array::reserve(Word count)
+   {
+      if(data || dense || shared || !count || count > DenseMax)
+         return;
+
+      dense    = new Word[count]{};
+      denseC   = count;
+      denseOwn = true;
+   }
+
+   //
+   // Array::reserve
+   //
+   void Array::reserve(Word count, Word *buf)
+   {
+      if(data || dense || shared || !count || count > DenseMax)
+         return;
+
+      dense    = buf;
+      denseC   = count;
+      denseOwn = false;
+   }
+
    //
    // Array::saveState
    //
    void Array::saveState(Serial &out) const
    {
       out.writeSign(Signature::Array);
-      WriteData(out, data);
+
+      // Dense and shared storage are written in the same form as pages.
+      if(denseC || sharedC)
+      {
+         Array arr;
+         for(Word i = 0; i != denseC; ++i)
+            if(dense[i]) arr[i] = dense[i];
+         for(Word i = 0; i != sharedC; ++i)
+            if(shared[i]) arr[i] = shared[i];
+
+         WriteData(out, arr.data);
+      }
+      else
+         WriteData(out, data);
+
       out.writeSign(~Signature::Array);
    }
 
+   //
+   // Array::share
+   //
+   bool Array::share(Word const *buf, Word count)
+   {
+      if(data || dense || shared || !count)
+         return false;
+
+      shared  = buf;
+      sharedC = count;
+      return true;
+   }
+
    //
    // Array::unlockStrings
    //
    void Array::unlockStrings(Environment *env) const
    {
+      for(Word i = 0; i != denseC; ++i)
+         RefStringsData(env, dense[i], [](String *s){--s->lock;});
+
+      for(Word i = 0; i != sharedC; ++i)
+         RefStringsData(env, shared[i], [](String *s){--s->lock;});
+
       RefStringsData(env, data, [](String *s){--s->lock;});
    }
+
+   //
+   // Array::unshare
+   //
+   // Copies shared contents into dense storage, or pages if too large, for
+   // the first write.
+   //
+   void Array::unshare()
+   {
+      Word const *sharedOld  = shared;
+      Word        sharedOldC = sharedC;
+
+      // Clearing sharedC makes operator [] allocate, and stops getWord from
+      // calling back into this.
+      shared  = nullptr;
+      sharedC = 0;
+
+      try
+      {
+         if(sharedOldC <= DenseMax)
+         {
+            reserve(sharedOldC);
+            std::copy(sharedOld, sharedOld + sharedOldC, dense);
+         }
+         else for(Word i = 0; i != sharedOldC; ++i)
+            if(sharedOld[i]) (*this)[i] = sharedOld[i];
+      }
+      catch(...)
+      {
+         clear();
+         shared  = sharedOld;
+         sharedC = sharedOldC;
+         throw;
+      }
+   }
 }
 
 // EOF
@@ -27,20 +27,48 @@ namespace ACSVM
    //
    // Sparse-allocation array of 2**32 Words.
    //
+   // Arrays with a known size can start out in dense storage, which is moved
+   // into sparse storage on the first write past its end. Initialized arrays
+   // can share read-only contents, which are copied on the first write. The
+   // last page accessed is cached, so that repeated accesses within a page do
+   // not walk the levels above it.
+   //
    class Array
    {
    public:
-      Array() : data{nullptr} {}
+      Array() : data{nullptr}, dense{nullptr}, denseC{0}, denseOwn{false},
+         shared{nullptr}, sharedC{0}, page{nullptr}, pageIdx{PageIdxNone} {}
       Array(Array const &) = delete;
-      Array(Array &&array) : data{array.data} {array.data = nullptr;}
+      Array(Array &&array) : data{array.data}, dense{array.dense},
+         denseC{array.denseC}, denseOwn{array.denseOwn}, shared{array.shared},
+         sharedC{array.sharedC}, page{array.page}, pageIdx{array.pageIdx}
+      {
+         array.data    = nullptr;
+         array.dense   = nullptr;
+         array.denseC  = 0;
+         array.shared  = nullptr;
+         array.sharedC = 0;
+         array.pageIdx = PageIdxNone;
+      }
       ~Array() {clear();}
 
-      Word &operator [] (Word idx);
+      Word &operator [] (Word idx)
+      {
+         if(idx < denseC) return dense[idx];
+         if(idx / PageSize == pageIdx) return (*page)[idx % PageSize];
+         return getWord(idx);
+      }
 
       void clear();
 
       // If idx is allocated, returns that Word. Otherwise, returns 0.
-      Word find(Word idx) const;
+      Word find(Word idx) const
+      {
+         if(idx < denseC) return dense[idx];
+         if(idx < sharedC) return shared[idx];
+         if(idx / PageSize == pageIdx) return (*page)[idx % PageSize];
+         return findPage(idx);
+      }
 
       void loadState(Serial &in);
 
@@ -48,10 +76,32 @@ namespace ACSVM
 
       void refStrings(Environment *env) const;
 
+      // Allocates dense storage for indexes below count. Only has an effect
+      // if the array is empty and count is no more than DenseMax.
+      void reserve(Word count);
+
+      // As above, but uses buf for dense storage instead of allocating. buf
+      // must hold count zeroed words, and must remain valid until the array
+      // is cleared, destructed or moved to sparse storage.
+      void reserve(Word count, Word *buf);
+
       void saveState(Serial &out) const;
 
+      // Uses the first count words of buf as the array's contents, until the
+      // first write copies them. buf must remain valid until then, or until
+      // the array is cleared or destructed. Returns false, without effect, if
+      // the array is not empty or count is 0.
+      bool share(Word const *buf, Word count);
+
       void unlockStrings(Environment *env) const;
 
+
+      // Frees the nodes kept for reuse by the calling thread. Freed nodes are
+      // otherwise kept until the thread exits.
+      static void FreeCache();
+
+      static constexpr Word DenseMax = 4096;
+
    private:
       static constexpr std::size_t PageSize = 256;
       static constexpr std::size_t SegmSize = 256;
@@ -63,7 +113,34 @@ namespace ACSVM
       using Bank = Segm*[BankSize];
       using Data = Bank*[DataSize];
 
+      // Never equal to idx / PageSize.
+      static constexpr Word PageIdxNone = ~static_cast<Word>(0);
+
+
+      Word findPage(Word idx) const;
+
+      void freeDense();
+
+      Page &getPage(Word idx);
+
+      Word &getWord(Word idx);
+
+      void moveDense();
+
+      void unshare();
+
       Data *data;
+
+      Word *dense;
+      Word  denseC;
+      bool  denseOwn; // dense was allocated by reserve.
+
+      Word const *shared;
+      Word        sharedC;
+
+      // Last page accessed and its index, or PageIdxNone.
+      mutable Page *page;
+      mutable Word  pageIdx;
    };
 }
 
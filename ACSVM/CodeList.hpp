@@ -50,6 +50,7 @@ ACSVM_CodeList(LOrI,         0)
 ACSVM_CodeList(MulX,         0)
 
 // Call codes.
+ACSVM_CodeList(Call_Bnd,     1)
 ACSVM_CodeList(Call_Lit,     1)
 ACSVM_CodeList(Call_Stk,     0)
 ACSVM_CodeList(CallFunc,     2)
@@ -126,10 +127,127 @@ ACSVM_CodeList(InvU,         0)
 ACSVM_CodeList(NegI,         0)
 ACSVM_CodeList(NotU,         0)
 
+// Fused codes.
+// Generated by Optimizer from sequences of the above codes. Only the first
+// code of the sequence is replaced, so argc covers the whole sequence.
+#define ACSVM_CodeList_FusedOp(name) \
+   ACSVM_CodeList(name##_Lit,         2) \
+   ACSVM_CodeList(name##_LocLit,      4) \
+   ACSVM_CodeList(name##_LocLit_Drop, 6) \
+   ACSVM_CodeList(name##_LocLoc,      4) \
+   ACSVM_CodeList(name##_LocLoc_Drop, 6)
+#define ACSVM_CodeList_FusedOpSet(name) \
+   ACSVM_CodeList_FusedOp(name) \
+   ACSVM_CodeList(name##_LocReg_Lit, 3) \
+   ACSVM_CodeList(name##_LocReg_Loc, 3)
+ACSVM_CodeList_FusedOpSet(AddU)
+ACSVM_CodeList_FusedOpSet(AndU)
+ACSVM_CodeList_FusedOpSet(DivI)
+ACSVM_CodeList_FusedOpSet(ModI)
+ACSVM_CodeList_FusedOpSet(MulU)
+ACSVM_CodeList_FusedOpSet(OrIU)
+ACSVM_CodeList_FusedOpSet(OrXU)
+ACSVM_CodeList_FusedOpSet(ShLU)
+ACSVM_CodeList_FusedOpSet(ShRI)
+ACSVM_CodeList_FusedOpSet(SubU)
+ACSVM_CodeList_FusedOp(CmpI_GE)
+ACSVM_CodeList_FusedOp(CmpI_GT)
+ACSVM_CodeList_FusedOp(CmpI_LE)
+ACSVM_CodeList_FusedOp(CmpI_LT)
+ACSVM_CodeList_FusedOp(CmpU_EQ)
+ACSVM_CodeList_FusedOp(CmpU_NE)
+ACSVM_CodeList_FusedOp(DivX)
+ACSVM_CodeList_FusedOp(LAnd)
+ACSVM_CodeList_FusedOp(LOrI)
+ACSVM_CodeList_FusedOp(MulX)
+#undef ACSVM_CodeList_FusedOpSet
+#undef ACSVM_CodeList_FusedOp
+ACSVM_CodeList(Drop_LocReg_Lit, 3)
+ACSVM_CodeList(Drop_LocReg_Loc, 3)
+#define ACSVM_CodeList_FusedJcmp(name) \
+   ACSVM_CodeList(Jcmp##name,         2) \
+   ACSVM_CodeList(Jcmp##name##_Lit,    4) \
+   ACSVM_CodeList(Jcmp##name##_LocLit, 6) \
+   ACSVM_CodeList(Jcmp##name##_LocLoc, 6)
+ACSVM_CodeList_FusedJcmp(I_GE)
+ACSVM_CodeList_FusedJcmp(I_GT)
+ACSVM_CodeList_FusedJcmp(I_LE)
+ACSVM_CodeList_FusedJcmp(I_LT)
+ACSVM_CodeList_FusedJcmp(U_EQ)
+ACSVM_CodeList_FusedJcmp(U_NE)
+#undef ACSVM_CodeList_FusedJcmp
+
+// Native code entry.
+// Generated by Optimizer for modules with registered native code. Replaces the
+// code at each point where execution can enter the native code.
+ACSVM_CodeList(Native,       0)
+
 #undef ACSVM_CodeList
 #endif
 
 
+#ifdef ACSVM_CodeListFusedOp
+
+// Codes with _Lit, _LocLit, and _LocLoc fused forms, and _LocLit_Drop and
+// _LocLoc_Drop forms that store the result to a local register.
+ACSVM_CodeListFusedOp(AddU)
+ACSVM_CodeListFusedOp(AndU)
+ACSVM_CodeListFusedOp(CmpI_GE)
+ACSVM_CodeListFusedOp(CmpI_GT)
+ACSVM_CodeListFusedOp(CmpI_LE)
+ACSVM_CodeListFusedOp(CmpI_LT)
+ACSVM_CodeListFusedOp(CmpU_EQ)
+ACSVM_CodeListFusedOp(CmpU_NE)
+ACSVM_CodeListFusedOp(DivI)
+ACSVM_CodeListFusedOp(DivX)
+ACSVM_CodeListFusedOp(LAnd)
+ACSVM_CodeListFusedOp(LOrI)
+ACSVM_CodeListFusedOp(ModI)
+ACSVM_CodeListFusedOp(MulU)
+ACSVM_CodeListFusedOp(MulX)
+ACSVM_CodeListFusedOp(OrIU)
+ACSVM_CodeListFusedOp(OrXU)
+ACSVM_CodeListFusedOp(ShLU)
+ACSVM_CodeListFusedOp(ShRI)
+ACSVM_CodeListFusedOp(SubU)
+
+#undef ACSVM_CodeListFusedOp
+#endif
+
+
+#ifdef ACSVM_CodeListFusedOpSet
+
+// Codes with _LocReg_Lit and _LocReg_Loc fused forms.
+ACSVM_CodeListFusedOpSet(AddU)
+ACSVM_CodeListFusedOpSet(AndU)
+ACSVM_CodeListFusedOpSet(DivI)
+ACSVM_CodeListFusedOpSet(Drop)
+ACSVM_CodeListFusedOpSet(ModI)
+ACSVM_CodeListFusedOpSet(MulU)
+ACSVM_CodeListFusedOpSet(OrIU)
+ACSVM_CodeListFusedOpSet(OrXU)
+ACSVM_CodeListFusedOpSet(ShLU)
+ACSVM_CodeListFusedOpSet(ShRI)
+ACSVM_CodeListFusedOpSet(SubU)
+
+#undef ACSVM_CodeListFusedOpSet
+#endif
+
+
+#ifdef ACSVM_CodeListFusedJcmp
+
+// Comparisons with fused Jcnd_Tru forms, and the comparison used for Jcnd_Nil.
+ACSVM_CodeListFusedJcmp(I_GE, I_LT)
+ACSVM_CodeListFusedJcmp(I_GT, I_LE)
+ACSVM_CodeListFusedJcmp(I_LE, I_GT)
+ACSVM_CodeListFusedJcmp(I_LT, I_GE)
+ACSVM_CodeListFusedJcmp(U_EQ, U_NE)
+ACSVM_CodeListFusedJcmp(U_NE, U_EQ)
+
+#undef ACSVM_CodeListFusedJcmp
+#endif
+
+
 #ifdef ACSVM_CodeListACS0
 
 ACSVM_CodeListACS0(Nop,            0, "",       Nop,          0, None)
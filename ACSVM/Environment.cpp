@@ -13,12 +13,14 @@
 #include "Environment.hpp"
 
 #include "Action.hpp"
+#include "Array.hpp"
 #include "BinaryIO.hpp"
 #include "CallFunc.hpp"
 #include "Code.hpp"
 #include "CodeData.hpp"
 #include "Function.hpp"
 #include "HashMap.hpp"
+#include "Jit.hpp"
 #include "Module.hpp"
 #include "PrintBuf.hpp"
 #include "Scope.hpp"
@@ -26,8 +28,18 @@
 #include "Serial.hpp"
 #include "Thread.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <iostream>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -46,6 +58,13 @@ namespace ACSVM
       using FuncName = std::pair<ModuleName, String *>;
       using FuncElem = HashMapElem<FuncName, Word>;
 
+      static constexpr std::size_t ThreadSlabC = 64;
+
+      struct ThreadSlab
+      {
+         alignas(Thread) unsigned char data[sizeof(Thread) * ThreadSlabC];
+      };
+
       struct NameEqual
       {
          bool operator () (ModuleName const *l, ModuleName const *r) const
@@ -96,6 +115,70 @@ namespace ACSVM
             {func, {FuncACS0::name, Func::transFunc, __VA_ARGS__}},
          #include "CodeList.hpp"
       };
+
+      // Native code and the translated code it was generated from.
+      struct NativeData
+      {
+         Word const *codeV;
+         NativeFunc  func;
+      };
+
+      // Keyed by code size in the high word and code hash in the low word.
+      std::unordered_multimap<DWord, NativeData> tableNative;
+
+      // Guard scriptAction and threadFree, which threads in any GlobalScope
+      // may use during execParallel. mutexThread is only taken while execBusy,
+      // as threadFree is otherwise only used by the calling thread.
+      std::mutex mutexAction;
+      std::mutex mutexThread;
+
+      // Worker pool for execParallel. Workers wait on execStart for execTic
+      // to change, then take scopes from execScopes until none are left.
+      std::vector<std::thread>   execPool;
+      std::vector<GlobalScope *> execScopes;
+      std::atomic<std::size_t>   execNext{0};
+      std::exception_ptr         execError;
+      std::mutex                 execMutex;
+      std::condition_variable    execStart;
+      std::condition_variable    execEnd;
+      std::size_t                execDone = 0;
+      std::size_t                execTic  = 0;
+      bool                       execBusy = false; // Pool is executing.
+      bool                       execQuit = false;
+
+      // Set if collectStrings is called while the pool is executing.
+      std::atomic<bool> collectPend{false};
+
+      // Actions added by queueAction, newest first.
+      std::atomic<ScriptAction *> actionQueue{nullptr};
+
+      // GlobalScopes left to execute in the current tic, for execUntil.
+      std::vector<Word> execIDs;
+      std::size_t       execIdx  = 0;
+      bool              execPend = false; // Tic is unfinished.
+
+      // Storage for threads made by the default allocThread. Threads are
+      // never freed individually, so slabs are only released on destruction.
+      std::vector<std::unique_ptr<ThreadSlab>> threadSlab;
+      std::size_t threadSlabUsed = ThreadSlabC; // Threads made from last slab.
+
+
+      //
+      // isSlabThread
+      //
+      bool isSlabThread(Thread const *thread) const
+      {
+         auto ptr = reinterpret_cast<unsigned char const *>(thread);
+         std::less<unsigned char const *> less;
+
+         for(auto const &slab : threadSlab)
+         {
+            if(!less(ptr, slab->data) && less(ptr, slab->data + sizeof(slab->data)))
+               return true;
+         }
+
+         return false;
+      }
    };
 }
 
@@ -111,7 +194,12 @@ namespace ACSVM
    //
    Environment::Environment() :
       branchLimit  {0},
+      codeFuse     {true},
+      codePeephole {false},
+      execBudget   {0},
+      jitThreshold {100},
       scriptLocRegC{ScriptLocRegCDefault},
+      tagNotify    {false},
 
       funcV{nullptr},
       funcC{0},
@@ -127,18 +215,30 @@ namespace ACSVM
    //
    Environment::~Environment()
    {
+      execPool(0);
+
       pd->functionByName.free();
       pd->modules.free();
       pd->scopes.free();
 
+      execQueue();
       while(scriptAction.next->obj)
          delete scriptAction.next->obj;
 
-      delete pd;
+      // Deallocate threads. Do this after scopes have been destructed, and
+      // before the slabs holding threads from allocThread are released.
+      while(Thread *thread = threadFree.next->obj)
+      {
+         if(pd->isSlabThread(thread))
+            thread->~Thread();
+         else
+            delete thread;
+      }
+
+      // Release the nodes freed with the scopes above.
+      Array::FreeCache();
 
-      // Deallocate threads. Do this after scopes have been destructed.
-      while(threadFree.next->obj)
-         delete threadFree.next->obj;
+      delete pd;
    }
 
    //
@@ -174,12 +274,47 @@ namespace ACSVM
          itr->second = std::move(data);
    }
 
+   //
+   // Environment::addNative
+   //
+   void Environment::addNative(Word const *codeV, Word codeC, Word codeHash, NativeFunc func)
+   {
+      DWord key   = static_cast<DWord>(codeC) << 32 | codeHash;
+      auto  range = pd->tableNative.equal_range(key);
+
+      // Replace native code registered for the same code.
+      for(auto itr = range.first; itr != range.second; ++itr)
+      {
+         if(std::equal(codeV, codeV + codeC, itr->second.codeV))
+         {
+            itr->second = {codeV, func};
+            return;
+         }
+      }
+
+      pd->tableNative.emplace(key, PrivData::NativeData{codeV, func});
+   }
+
    //
    // Environment::allocThread
    //
+   //
+   // Threads are constructed in slabs, which keeps them close together and
+   // saves an allocation for most new threads.
+   //
    Thread *Environment::allocThread()
    {
-      return new Thread(this);
+      if(pd->threadSlabUsed == PrivData::ThreadSlabC)
+      {
+         std::unique_ptr<PrivData::ThreadSlab> slab{new PrivData::ThreadSlab};
+         pd->threadSlab.push_back(std::move(slab));
+         pd->threadSlabUsed = 0;
+      }
+
+      void *mem = pd->threadSlab.back()->data + sizeof(Thread) * pd->threadSlabUsed;
+      Thread *thread = new(mem) Thread(this);
+      ++pd->threadSlabUsed;
+      return thread;
    }
 
    //
@@ -234,6 +369,16 @@ namespace ACSVM
    //
    void Environment::collectStrings()
    {
+      // Other workers may be using strings, so wait until the tic ends.
+      if(pd->execBusy)
+      {
+         pd->collectPend = true;
+         return;
+      }
+
+      // Queued actions are only referenced once in scriptAction.
+      execQueue();
+
       stringTable.collectBegin();
       refStrings();
       stringTable.collectEnd();
@@ -260,7 +405,10 @@ namespace ACSVM
    //
    void Environment::deferAction(ScriptAction &&action)
    {
-      (new ScriptAction(std::move(action)))->link.insert(&scriptAction);
+      auto act = new ScriptAction(std::move(action));
+
+      std::lock_guard<std::mutex> lock{pd->mutexAction};
+      act->link.insert(&scriptAction);
    }
 
    //
@@ -268,7 +416,20 @@ namespace ACSVM
    //
    void Environment::exec()
    {
-      // Delegate deferred script actions.
+      execUntil(std::chrono::steady_clock::time_point::max());
+   }
+
+   //
+   // Environment::execActions
+   //
+   // Delegates deferred script actions.
+   //
+   void Environment::execActions()
+   {
+      execQueue();
+
+      std::lock_guard<std::mutex> lock{pd->mutexAction};
+
       for(auto itr = scriptAction.begin(), end = scriptAction.end(); itr != end;)
       {
          auto scope = pd->scopes.find(itr->id.global);
@@ -277,12 +438,239 @@ namespace ACSVM
          else
             ++itr;
       }
+   }
+
+   //
+   // Environment::execFor
+   //
+   bool Environment::execFor(std::chrono::nanoseconds budget)
+   {
+      auto now = std::chrono::steady_clock::now();
+      auto end = std::chrono::steady_clock::time_point::max();
+
+      if(budget < end - now)
+         end = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+
+      return execUntil(end);
+   }
+
+   //
+   // Environment::execJit
+   //
+   // Compiles code found hot during earlier tics, while no thread is executing.
+   //
+   void Environment::execJit()
+   {
+      for(auto &module : pd->modules)
+      {
+         if(module.jit)
+            module.jit->compile();
+      }
+   }
+
+   //
+   // Environment::execParallel
+   //
+   void Environment::execParallel(unsigned workers)
+   {
+      if(pd->execPend)
+      {
+         execUntil(std::chrono::steady_clock::time_point::max());
+         return;
+      }
+
+      execActions();
+      execJit();
 
+      pd->execScopes.clear();
       for(auto &scope : pd->scopes)
       {
          if(scope.active)
-            scope.exec();
+            pd->execScopes.push_back(&scope);
+      }
+
+      if(workers > pd->execScopes.size())
+         workers = pd->execScopes.size();
+
+      if(workers <= 1)
+      {
+         for(auto scope : pd->execScopes)
+            scope->exec();
+         return;
+      }
+
+      // The calling thread is one of the workers.
+      execPool(workers - 1);
+
+      {
+         std::lock_guard<std::mutex> lock{pd->execMutex};
+         pd->execNext  = 0;
+         pd->execDone  = 0;
+         pd->execError = nullptr;
+         pd->execBusy  = true;
+         ++pd->execTic;
+      }
+      pd->execStart.notify_all();
+
+      execWork();
+
+      // Wait for the other workers to finish the tic.
+      {
+         std::unique_lock<std::mutex> lock{pd->execMutex};
+         pd->execEnd.wait(lock, [this]{return pd->execDone == pd->execPool.size();});
+         pd->execBusy = false;
       }
+
+      if(pd->execError)
+         std::rethrow_exception(pd->execError);
+
+      if(pd->collectPend.exchange(false))
+         collectStrings();
+   }
+
+   //
+   // Environment::execPool
+   //
+   // Sets the number of pool threads, stopping the existing ones if different.
+   //
+   void Environment::execPool(unsigned workers)
+   {
+      if(pd->execPool.size() == workers)
+         return;
+
+      if(!pd->execPool.empty())
+      {
+         {
+            std::lock_guard<std::mutex> lock{pd->execMutex};
+            pd->execQuit = true;
+         }
+         pd->execStart.notify_all();
+
+         for(auto &thread : pd->execPool)
+            thread.join();
+
+         pd->execPool.clear();
+         pd->execQuit = false;
+      }
+
+      pd->execPool.reserve(workers);
+      while(pd->execPool.size() != workers)
+         pd->execPool.emplace_back(&Environment::execWorker, this, pd->execTic);
+   }
+
+   //
+   // Environment::execQueue
+   //
+   // Moves actions added by queueAction to scriptAction, in the order added.
+   //
+   void Environment::execQueue()
+   {
+      ScriptAction *queue = pd->actionQueue.exchange(nullptr, std::memory_order_acquire);
+      if(!queue)
+         return;
+
+      ScriptAction *order = nullptr;
+      while(queue)
+      {
+         ScriptAction *next = queue->queueNext;
+         queue->queueNext = order;
+         order = queue;
+         queue = next;
+      }
+
+      std::lock_guard<std::mutex> lock{pd->mutexAction};
+
+      for(; order; order = order->queueNext)
+         order->link.insert(&scriptAction);
+   }
+
+   //
+   // Environment::execWork
+   //
+   // Executes scopes from execScopes until none are left.
+   //
+   void Environment::execWork()
+   {
+      try
+      {
+         std::size_t i;
+         while((i = pd->execNext++) < pd->execScopes.size())
+            pd->execScopes[i]->exec();
+      }
+      catch(...)
+      {
+         std::lock_guard<std::mutex> lock{pd->execMutex};
+         if(!pd->execError)
+            pd->execError = std::current_exception();
+      }
+   }
+
+   //
+   // Environment::execWorker
+   //
+   // Entry point for pool threads. Waits for the tic after the given one.
+   //
+   void Environment::execWorker(std::size_t tic)
+   {
+      for(;;)
+      {
+         {
+            std::unique_lock<std::mutex> lock{pd->execMutex};
+            pd->execStart.wait(lock, [&]{return pd->execQuit || pd->execTic != tic;});
+
+            if(pd->execQuit)
+               break;
+
+            tic = pd->execTic;
+         }
+
+         execWork();
+
+         {
+            std::lock_guard<std::mutex> lock{pd->execMutex};
+            ++pd->execDone;
+         }
+         pd->execEnd.notify_one();
+      }
+
+      // Nodes freed by the worker are kept for reuse between tics, until the
+      // pool is shut down.
+      Array::FreeCache();
+   }
+
+   //
+   // Environment::execUntil
+   //
+   bool Environment::execUntil(std::chrono::steady_clock::time_point end)
+   {
+      bool ran = false;
+
+      if(!pd->execPend)
+      {
+         execActions();
+         execJit();
+
+         pd->execIDs.clear();
+         for(auto &scope : pd->scopes)
+         {
+            if(scope.active)
+               pd->execIDs.push_back(scope.id);
+         }
+
+         pd->execIdx  = 0;
+         pd->execPend = true;
+      }
+
+      // Scopes are found by id, in case any are freed between calls.
+      for(; pd->execIdx != pd->execIDs.size(); ++pd->execIdx)
+      {
+         auto scope = pd->scopes.find(pd->execIDs[pd->execIdx]);
+         if(scope && scope->active && !scope->execUntil(end, ran))
+            return false;
+      }
+
+      pd->execPend = false;
+      return true;
    }
 
    //
@@ -311,6 +699,25 @@ namespace ACSVM
       return pd->modules.find(name);
    }
 
+   //
+   // Environment::findNative
+   //
+   // Only returns native code generated from the same code, in case of hash
+   // collisions.
+   //
+   NativeFunc Environment::findNative(Word const *codeV, Word codeC, Word codeHash) const
+   {
+      auto range = pd->tableNative.equal_range(static_cast<DWord>(codeC) << 32 | codeHash);
+
+      for(auto itr = range.first; itr != range.second; ++itr)
+      {
+         if(std::equal(codeV, codeV + codeC, itr->second.codeV))
+            return itr->second.func;
+      }
+
+      return nullptr;
+   }
+
    //
    // Environment::freeFunction
    //
@@ -354,6 +761,11 @@ namespace ACSVM
    //
    void Environment::freeThread(Thread *thread)
    {
+      std::unique_lock<std::mutex> lock{pd->mutexThread, std::defer_lock};
+      if(pd->execBusy) lock.lock();
+
+      thread->execRun = false;
+      thread->linkExec.unlink();
       thread->link.relink(&threadFree);
    }
 
@@ -380,6 +792,9 @@ namespace ACSVM
    //
    Thread *Environment::getFreeThread()
    {
+      std::unique_lock<std::mutex> lock{pd->mutexThread, std::defer_lock};
+      if(pd->execBusy) lock.lock();
+
       if(threadFree.next->obj)
       {
          Thread *thread = threadFree.next->obj;
@@ -573,6 +988,15 @@ namespace ACSVM
       resetStrings();
    }
 
+   //
+   // Environment::notifyTag
+   //
+   void Environment::notifyTag(Word type, Word tag)
+   {
+      for(auto &scope : pd->scopes)
+         scope.notifyTag(type, tag);
+   }
+
    //
    // Environment::printArray
    //
@@ -590,6 +1014,20 @@ namespace ACSVM
          << " at " << (thread->codePtr - thread->module->codeV.data() - 1) << '\n';
    }
 
+   //
+   // Environment::queueAction
+   //
+   void Environment::queueAction(ScriptAction &&action)
+   {
+      auto act = new ScriptAction(std::move(action));
+
+      act->queueNext = pd->actionQueue.load(std::memory_order_relaxed);
+      while(!pd->actionQueue.compare_exchange_weak(act->queueNext, act,
+         std::memory_order_release, std::memory_order_relaxed))
+      {
+      }
+   }
+
    //
    // Environment::readModuleName
    //
@@ -687,6 +1125,26 @@ namespace ACSVM
          scope.refStrings();
    }
 
+   //
+   // Environment::reserveThreads
+   //
+   void Environment::reserveThreads(std::size_t count)
+   {
+      std::unique_lock<std::mutex> lock{pd->mutexThread, std::defer_lock};
+      if(pd->execBusy) lock.lock();
+
+      for(Thread *thread = threadFree.next->obj; thread && count;
+         thread = thread->link.next->obj)
+         --count;
+
+      for(; count; --count)
+      {
+         Thread *thread = allocThread();
+         thread->link.relink(&threadFree);
+         thread->reserve();
+      }
+   }
+
    //
    // Environment::resetStrings
    //
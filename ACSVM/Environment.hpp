@@ -16,6 +16,8 @@
 #include "List.hpp"
 #include "String.hpp"
 
+#include <chrono>
+
 
 //----------------------------------------------------------------------------|
 // Types                                                                      |
@@ -39,6 +41,13 @@ namespace ACSVM
       void addCodeDataACS0(Word code, CodeDataACS0 &&data);
       void addFuncDataACS0(Word func, FuncDataACS0 &&data);
 
+      // Registers native code, such as generated by acsvm-aot, for modules
+      // whose translated code is the same as codeV. codeHash is used to find
+      // candidates, which are then compared in full. codeV must remain valid
+      // for the Environment's lifetime. Only affects modules loaded
+      // afterwards.
+      void addNative(Word const *codeV, Word codeC, Word codeHash, NativeFunc func);
+
       virtual bool callFunc(Thread *thread, Word func, Word const *argV, Word argC);
       Word callSpec(Thread *thread, Word spec, Word const *argV, Word argC);
 
@@ -56,13 +65,37 @@ namespace ACSVM
 
       void deferAction(ScriptAction &&action);
 
+      // Executes a tic. If a tic begun by execFor is unfinished, finishes it
+      // instead.
       virtual void exec();
 
+      // Executes until the current tic is finished or budget has passed,
+      // returning true if the tic was finished. An unfinished tic resumes on
+      // the next call to execFor or exec, and a new tic begins only after it
+      // is finished. Time is checked between threads, and within a thread
+      // only when it uses up execBudget. At least one thread is executed
+      // first, if any are left, so that every call makes progress.
+      bool execFor(std::chrono::nanoseconds budget);
+
+      // Executes each active GlobalScope on one of up to workers threads,
+      // including the calling thread, returning once all have finished the
+      // tic. Threads in different GlobalScopes may then run concurrently, so
+      // any overridden functions they call (callFunc, callSpecImpl, checkLock,
+      // checkTag, printArray and printKill) must be safe to do so. String lock
+      // and ref must not be changed by them. If a tic
+      // begun by execFor is unfinished, finishes it serially instead.
+      void execParallel(unsigned workers);
+
+      // As execFor, but with a deadline instead of a budget.
+      bool execUntil(std::chrono::steady_clock::time_point end);
+
       CodeDataACS0 const *findCodeDataACS0(Word code);
       FuncDataACS0 const *findFuncDataACS0(Word func);
 
       Module *findModule(ModuleName const &name) const;
 
+      NativeFunc findNative(Word const *codeV, Word codeC, Word codeHash) const;
+
       // Used by Module when unloading.
       void freeFunction(Function *func);
 
@@ -97,6 +130,10 @@ namespace ACSVM
       // Default behavior is to return the type as-is.
       virtual Word getScriptTypeACSE(Word type) {return type;}
 
+      // Called to get the priority of scripts after translating their type.
+      // Default behavior is to return 0.
+      virtual Word getScriptPriority(Word /*type*/) {return 0;}
+
       String *getString(Word idx) {return &stringTable[~idx];}
 
       String *getString(char const *first, char const *last)
@@ -116,6 +153,10 @@ namespace ACSVM
 
       virtual void loadState(Serial &in);
 
+      // Wakes threads waiting on the given tag so that checkTag is called for
+      // them on their next execution. Only needed if tagNotify.
+      void notifyTag(Word type, Word tag);
+
       // Prints an array to a print buffer. Default behavior is PrintArrayChar.
       virtual void printArray(PrintBuf &buf, Array const &array, Word index, Word limit);
 
@@ -123,6 +164,11 @@ namespace ACSVM
       // message to stderr.
       virtual void printKill(Thread *thread, Word type, Word data);
 
+      // Adds an action to be delegated at the start of the next exec. Unlike
+      // deferAction, this does not lock and may be called from any thread at
+      // any time. Strings used by the action must not be collected before then.
+      void queueAction(ScriptAction &&action);
+
       // Deserializes a ModuleName. Default behavior is to load s and i.
       virtual ModuleName readModuleName(Serial &in) const;
 
@@ -134,6 +180,10 @@ namespace ACSVM
 
       virtual void refStrings();
 
+      // Ensures at least count threads are free, with storage for scripts
+      // using default stack sizes, so that starting scripts does not allocate.
+      void reserveThreads(std::size_t count);
+
       virtual void resetStrings();
 
       virtual void saveState(Serial &out) const;
@@ -149,13 +199,39 @@ namespace ACSVM
 
       StringTable stringTable;
 
-      // Number of branches allowed per call to Thread::exec. Default of 0
-      // means no limit.
+      // Number of branches allowed before a thread delays or waits. Default
+      // of 0 means no limit.
       Word branchLimit;
 
+      // If true, common code sequences are replaced with fused codes when
+      // modules are loaded. Only affects modules loaded afterwards. Default is
+      // true.
+      bool codeFuse;
+
+      // If true, redundant codes are removed and literal expressions folded
+      // when modules are loaded. This changes code indexes, so saved states
+      // must be loaded with the same setting. Only affects modules loaded
+      // afterwards. Default is false.
+      bool codePeephole;
+
+      // Number of branches allowed per call to Thread::exec before the thread
+      // is suspended, resuming on its next exec. Branches still count toward
+      // branchLimit across suspensions. Default of 0 means no budget.
+      Word execBudget;
+
+      // Number of calls to a function, or branches back to a code, before it
+      // is compiled to machine code at the start of a tic. Only used if built
+      // with ACSVM_JIT for a supported target. Only affects modules loaded
+      // afterwards. Default is 100, and 0 disables compiling.
+      Word jitThreshold;
+
       // Default number of script variables. Default is 20.
       Word scriptLocRegC;
 
+      // If true, threads waiting on a tag are not checked every tic, only after
+      // notifyTag is called for that tag. Default is false.
+      bool tagNotify;
+
 
       // Prints an array to a print buffer, truncating elements of the array to
       // fit char.
@@ -185,6 +261,13 @@ namespace ACSVM
    private:
       struct PrivData;
 
+      void execActions();
+      void execJit();
+      void execQueue();
+      void execPool(unsigned workers);
+      void execWork();
+      void execWorker(std::size_t tic);
+
       void loadFunctions(Serial &in);
       void loadGlobalScopes(Serial &in);
       void loadScriptActions(Serial &in);
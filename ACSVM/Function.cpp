@@ -32,7 +32,11 @@ namespace ACSVM
       locArrC{0},
       locRegC{0},
 
-      flagRet{false}
+      callStkC{0},
+      dataStkC{0},
+
+      flagRet{false},
+      flagStk{false}
    {
    }
 
@@ -14,6 +14,7 @@
 #define ACSVM__Function_H__
 
 #include "Types.hpp"
+#include "Vector.hpp"
 
 
 //----------------------------------------------------------------------------|
@@ -40,7 +41,16 @@ namespace ACSVM
       Word    locArrC;
       Word    locRegC;
 
+      // Declared size of each local array, if known.
+      Vector<Word> locArrSizeV;
+
+      // Call frames and data stack words used by the function and everything
+      // it calls. Only valid if flagStk is set.
+      Word    callStkC;
+      Word    dataStkC;
+
       bool flagRet : 1;
+      bool flagStk : 1; // Stack use is statically bounded.
    };
 }
 
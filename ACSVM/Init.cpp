@@ -17,6 +17,8 @@
 #include "Module.hpp"
 #include "String.hpp"
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 
 
@@ -31,7 +33,13 @@ namespace ACSVM
    //
    struct ArrayInit::PrivData
    {
+      PrivData() : imageC{0} {}
+
       std::vector<WordInit> initV;
+
+      // Initialized contents, built by finish. Null if all zero.
+      std::unique_ptr<Word[]> image;
+      Word                    imageC;
    };
 }
 
@@ -62,30 +70,41 @@ namespace ACSVM
    //
    // ArrayInit::apply
    //
-   void ArrayInit::apply(Array &arr, Module *module)
+   void ArrayInit::apply(Array &arr)
    {
-      Word idx = 0;
-      for(WordInit &init : pd->initV)
-      {
-         Word value = init.getValue(module);
-         if(value) arr[idx] = value;
-         ++idx;
-      }
+      if(!pd->image || arr.share(pd->image.get(), pd->imageC))
+         return;
+
+      for(Word idx = 0; idx != pd->imageC; ++idx)
+         if(pd->image[idx]) arr[idx] = pd->image[idx];
    }
 
    //
    // ArrayInit::finish
    //
-   void ArrayInit::finish()
+   void ArrayInit::finish(Module *module)
    {
-      // Clear out trailing zeroes.
-      while(!pd->initV.empty() && !pd->initV.back())
+      // Clear out trailing zeroes. Those within the declared size are kept
+      // if it fits in dense storage, so that copies of the image get dense
+      // storage for all of it, as uninitialized arrays do.
+      while(pd->initV.size() > Array::DenseMax && !pd->initV.back())
          pd->initV.pop_back();
 
-      // Shrink vector.
-      pd->initV.shrink_to_fit();
+      // An image of only zeroes would cost memory for no effect, so such
+      // arrays are left to be reserved as if uninitialized.
+      if(std::any_of(pd->initV.begin(), pd->initV.end(),
+         [module](WordInit const &init){return init.getValue(module) != 0;}))
+      {
+         pd->imageC = pd->initV.size();
+         pd->image.reset(new Word[pd->imageC]);
 
-      // TODO: Break up initialization data into nonzero ranges.
+         std::transform(pd->initV.begin(), pd->initV.end(), pd->image.get(),
+            [module](WordInit const &init){return init.getValue(module);});
+      }
+
+      // Only the image is used after this.
+      pd->initV.clear();
+      pd->initV.shrink_to_fit();
    }
 
    //
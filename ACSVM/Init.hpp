@@ -41,9 +41,13 @@ namespace ACSVM
       ArrayInit();
       ~ArrayInit();
 
-      void apply(Array &arr, Module *module);
+      // Initializes arr, which shares contents with other arrays initialized
+      // from this until written.
+      void apply(Array &arr);
 
-      void finish();
+      // Builds the contents shared by apply. Must be called once, after all
+      // values are set and before any call to apply.
+      void finish(Module *module);
 
       void reserve(Word count);
 
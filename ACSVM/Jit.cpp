@@ -0,0 +1,1048 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2017 David Hill
+//
+// See COPYING for license information.
+//
+//-----------------------------------------------------------------------------
+//
+// Runtime native code generation.
+//
+//-----------------------------------------------------------------------------
+
+#include "Jit.hpp"
+
+#include "Code.hpp"
+#include "CodeData.hpp"
+#include "Environment.hpp"
+#include "Jump.hpp"
+#include "Module.hpp"
+#include "OpFunc.hpp"
+#include "Optimizer.hpp"
+#include "Thread.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+
+//----------------------------------------------------------------------------|
+// Macros                                                                     |
+//
+
+//
+// ACSVM_JIT
+//
+// If nonzero, enables JitModule. Set by the ACSVM_JIT CMake option.
+//
+#ifndef ACSVM_JIT
+#define ACSVM_JIT 0
+#endif
+
+//
+// ACSVM_JitX64
+//
+// If nonzero, machine code is generated for x86-64 with the System V calling
+// convention, in memory from mmap.
+//
+#if ACSVM_JIT && defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define ACSVM_JitX64 1
+#else
+#define ACSVM_JitX64 0
+#endif
+
+#if ACSVM_JitX64
+#include <sys/mman.h>
+#endif
+
+
+//----------------------------------------------------------------------------|
+// Types                                                                      |
+//
+
+namespace ACSVM
+{
+   //
+   // JitFrame
+   //
+   // Execution state passed to and from compiled code.
+   //
+   struct JitFrame
+   {
+      Word *stk;
+      Word *loc;
+      Word  branches;
+      Word  idx;
+   };
+
+   //
+   // JitEnter
+   //
+   // The start of each block of compiled code. Loads the frame and jumps to
+   // entry, returning false if the thread ran out of branches.
+   //
+   using JitEnter = bool (*)(JitFrame *frame, void const *entry);
+
+   //
+   // JitEntry
+   //
+   struct JitEntry
+   {
+      JitEnter    enter;
+      Byte const *addr;
+   };
+
+   //
+   // JitOp
+   //
+   // Binary operators, named by their OpFunc.
+   //
+   enum class JitOp
+   {
+      #define ACSVM_CodeListFusedOp(name) name,
+      #include "CodeList.hpp"
+
+      Drop,
+   };
+
+   //
+   // JitModule::PrivData
+   //
+   struct JitModule::PrivData
+   {
+      std::vector<bool>     codeIdx; // Set for each index that starts a code.
+      std::vector<JitEntry> entryV;  // Compiled entry for each code index.
+
+      std::vector<std::pair<void *, std::size_t>> blockV;
+
+      std::vector<Word> pendV;
+      std::mutex        pendMutex;
+   };
+
+   #if ACSVM_JitX64
+   //
+   // JitWriter
+   //
+   // Generates the machine code for one block. Each code's template keeps the
+   // data stack pointer in rbx, local registers in r12, branches in r13d, and
+   // the JitFrame in r14. eax and ecx hold operands.
+   //
+   class JitWriter
+   {
+   public:
+      JitWriter(Module *module, JitModule::PrivData *pd);
+
+      bool write(Word root);
+
+      std::vector<Byte> code;
+      std::vector<Word> entries; // Code indexes to enter the block at.
+      std::vector<Word> labelV;  // Offset of each compiled code index.
+
+   private:
+      enum Reg {EAX = 0, ECX = 1, EBX = 3, R12 = 12, R13 = 13, R14 = 14};
+
+      void find(Word root);
+
+      void writeBranch(Word target);
+
+      bool writeCode(Word iter);
+
+      void writeExit(Word idx, bool cont);
+
+      void writeGoto(Word target);
+
+      void writeJcc(Byte cc, Word target);
+
+      void writeOp(JitOp op);
+
+      void writeOpLoc(JitOp op, Word lop, bool lit, Word rop, Word dst);
+
+      void put(std::initializer_list<Byte> bytes);
+      void putMem(std::initializer_list<Byte> op, int reg, int base, SWord disp, bool w = false);
+      void putRel32(std::size_t pos);
+      void putWord(Word w);
+
+      void loadImm(Reg reg, Word val) {put({Byte(0xB8 + reg)}); putWord(val);}
+      void loadLoc(Reg reg, Word idx) {putMem({0x8B}, reg, R12, locDisp(idx));}
+      void loadStk(Reg reg, SWord n)  {putMem({0x8B}, reg, EBX, -4 * n);}
+      void storeLoc(Reg reg, Word idx) {putMem({0x89}, reg, R12, locDisp(idx));}
+      void storeStk(Reg reg, SWord n)  {putMem({0x89}, reg, EBX, -4 * n);}
+      void stkAdd(SWord n);
+
+      Code getCode(Word iter) {return static_cast<Code>(codeV[iter]);}
+
+      std::size_t getCodeSize(Word iter);
+
+      SWord locDisp(Word idx);
+
+      Module              *module;
+      JitModule::PrivData *pd;
+      Word const          *codeV;
+      Word                 codeC;
+
+      std::vector<bool> codeJit;  // Set for each code compiled in this block.
+      std::vector<bool> codeSeen; // Set for each code reached from the root.
+      std::vector<bool> codeRes;  // Set for each code Thread::exec resumes at.
+
+      std::vector<std::pair<std::size_t, Word>> fixupV; // rel32 to a label.
+
+      std::size_t epilogue;
+
+      bool fail;
+   };
+   #endif
+}
+
+
+//----------------------------------------------------------------------------|
+// Static Objects                                                             |
+//
+
+namespace ACSVM
+{
+   #if ACSVM_JitX64
+   // Condition codes for each comparison.
+   static constexpr Byte JitCC_I_GE = 0xD;
+   static constexpr Byte JitCC_I_GT = 0xF;
+   static constexpr Byte JitCC_I_LE = 0xE;
+   static constexpr Byte JitCC_I_LT = 0xC;
+   static constexpr Byte JitCC_U_EQ = 0x4;
+   static constexpr Byte JitCC_U_NE = 0x5;
+   #endif
+}
+
+
+//----------------------------------------------------------------------------|
+// Static Functions                                                           |
+//
+
+namespace ACSVM
+{
+   #if ACSVM_JitX64
+   //
+   // IsJitCode
+   //
+   // Returns true if code is run by compiled code. Other codes return control
+   // to Thread::exec.
+   //
+   static bool IsJitCode(Code code)
+   {
+      switch(code)
+      {
+      case Code::Nop:
+      case Code::DecU_LocReg:
+      case Code::IncU_LocReg:
+      case Code::Drop_Nul:
+      case Code::Jcnd_Lit:
+      case Code::Jcnd_Nil:
+      case Code::Jcnd_Tru:
+      case Code::Jump_Lit:
+      case Code::Push_Lit:
+      case Code::Push_LitArr:
+      case Code::Push_LocReg:
+      case Code::Copy:
+      case Code::Swap:
+      case Code::InvU:
+      case Code::NegI:
+      case Code::NotU:
+         return true;
+
+         #define ACSVM_CodeListFusedOp(name) \
+            case Code::name: \
+            case Code::name##_Lit: \
+            case Code::name##_LocLit: \
+            case Code::name##_LocLit_Drop: \
+            case Code::name##_LocLoc: \
+            case Code::name##_LocLoc_Drop:
+         #include "CodeList.hpp"
+         return true;
+
+         #define ACSVM_CodeListFusedOpSet(name) \
+            case Code::name##_LocReg: \
+            case Code::name##_LocReg_Lit: \
+            case Code::name##_LocReg_Loc:
+         #include "CodeList.hpp"
+         return true;
+
+         #define ACSVM_CodeListFusedJcmp(name, inv) \
+            case Code::Jcmp##name: \
+            case Code::Jcmp##name##_Lit: \
+            case Code::Jcmp##name##_LocLit: \
+            case Code::Jcmp##name##_LocLoc:
+         #include "CodeList.hpp"
+         return true;
+
+      default:
+         return false;
+      }
+   }
+
+   //
+   // IsJitExit
+   //
+   // Returns true if execution never continues to the code after code.
+   //
+   static bool IsJitExit(Code code)
+   {
+      switch(code)
+      {
+      case Code::Kill:
+      case Code::Retn:
+      case Code::ScrRestart:
+      case Code::ScrTerm:
+      case Code::Jump_Lit:
+      case Code::Jump_Stk:
+      case Code::Native:
+      case Code::None:
+         return true;
+
+      default:
+         return false;
+      }
+   }
+
+   //
+   // JitCodeSize
+   //
+   static std::size_t JitCodeSize(Module *module, Word const *codeV, std::size_t codeC,
+      std::size_t iter)
+   {
+      switch(Code code = static_cast<Code>(codeV[iter]))
+      {
+      case Code::CallFunc_Lit:
+      case Code::CallSpec_Lit:
+         return iter + 1 < codeC ? 3 + codeV[iter + 1] : 1;
+
+      case Code::Push_LitArr:
+         return iter + 1 < codeC ? 2 + codeV[iter + 1] : 1;
+
+      default:
+         return 1 + module->env->getCodeData(code)->argc;
+      }
+   }
+
+   //
+   // JitNative
+   //
+   static bool JitNative(Thread *thread, Word &branches)
+   {
+      return thread->module->jit->exec(thread, branches);
+   }
+
+   //
+   // JitOpFunc
+   //
+   // Called by compiled code for operators without a template.
+   //
+   template<void (*Op)(Word &, Word)>
+   static Word JitOpFunc(Word lop, Word rop)
+   {
+      Op(lop, rop);
+      return lop;
+   }
+   #endif
+}
+
+
+//----------------------------------------------------------------------------|
+// Extern Functions                                                           |
+//
+
+namespace ACSVM
+{
+   #if ACSVM_JitX64
+   //
+   // JitWriter constructor
+   //
+   JitWriter::JitWriter(Module *module_, JitModule::PrivData *pd_) :
+      module{module_},
+      pd    {pd_},
+      codeV {module_->codeSrcV.data()},
+      codeC {static_cast<Word>(module_->codeSrcV.size())},
+
+      codeJit (codeC),
+      codeSeen(codeC),
+      codeRes (codeC),
+
+      epilogue{0},
+
+      fail{false}
+   {
+   }
+
+   //
+   // JitWriter::find
+   //
+   // Finds the codes reachable from root, stopping at codes already compiled
+   // in another block.
+   //
+   void JitWriter::find(Word root)
+   {
+      std::vector<Word> work{root};
+
+      while(!work.empty())
+      {
+         Word iter = work.back(); work.pop_back();
+
+         if(iter >= codeC || !pd->codeIdx[iter] || codeSeen[iter])
+            continue;
+
+         if(iter != root && pd->entryV[iter].enter)
+            continue;
+
+         codeSeen[iter] = true;
+
+         Code        code = getCode(iter);
+         std::size_t size = getCodeSize(iter);
+         Word const *c    = &codeV[iter];
+
+         if(iter + size > codeC)
+            continue;
+
+         if(!IsJitExit(code))
+            work.push_back(iter + size);
+
+         if(!IsJitCode(code))
+         {
+            // Thread::exec runs the code, then can enter again at the next.
+            if(iter + size < codeC)
+               codeRes[iter + size] = true;
+
+            if(code == Code::Jcnd_Tab && c[1] < module->jumpMapV.size())
+            {
+               for(auto &jump : module->jumpMapV[c[1]].table)
+               {
+                  if(jump.val < codeC)
+                     codeRes[jump.val] = true;
+                  work.push_back(jump.val);
+               }
+            }
+
+            continue;
+         }
+
+         codeJit[iter] = true;
+
+         switch(code)
+         {
+            #define ACSVM_CodeListFusedJcmp(name, inv) \
+               case Code::Jcmp##name:         work.push_back(c[2]); break; \
+               case Code::Jcmp##name##_Lit:    work.push_back(c[4]); break; \
+               case Code::Jcmp##name##_LocLit: work.push_back(c[6]); break; \
+               case Code::Jcmp##name##_LocLoc: work.push_back(c[6]); break;
+            #include "CodeList.hpp"
+
+         case Code::Jcnd_Lit: work.push_back(c[2]); break;
+         case Code::Jcnd_Nil: work.push_back(c[1]); break;
+         case Code::Jcnd_Tru: work.push_back(c[1]); break;
+         case Code::Jump_Lit: work.push_back(c[1]); break;
+
+         default: break;
+         }
+      }
+   }
+
+   //
+   // JitWriter::getCodeSize
+   //
+   std::size_t JitWriter::getCodeSize(Word iter)
+   {
+      return JitCodeSize(module, codeV, codeC, iter);
+   }
+
+   //
+   // JitWriter::locDisp
+   //
+   SWord JitWriter::locDisp(Word idx)
+   {
+      if(idx > 0x1FFFFFFF)
+         fail = true;
+
+      return static_cast<SWord>(idx * 4);
+   }
+
+   //
+   // JitWriter::put
+   //
+   void JitWriter::put(std::initializer_list<Byte> bytes)
+   {
+      code.insert(code.end(), bytes);
+   }
+
+   //
+   // JitWriter::putMem
+   //
+   // Writes an instruction with a 32-bit register and a memory operand at
+   // base plus disp. If w is set, the register is 64-bit instead.
+   //
+   void JitWriter::putMem(std::initializer_list<Byte> op, int reg, int base, SWord disp, bool w)
+   {
+      Byte rex = 0x40 | (w ? 0x08 : 0) | (reg & 8 ? 0x04 : 0) | (base & 8 ? 0x01 : 0);
+      if(rex != 0x40)
+         code.push_back(rex);
+
+      put(op);
+      code.push_back(0x80 | (reg & 7) << 3 | (base & 7));
+
+      // r12 can only be a base through SIB.
+      if((base & 7) == 4)
+         code.push_back(0x24);
+
+      putWord(static_cast<Word>(disp));
+   }
+
+   //
+   // JitWriter::putRel32
+   //
+   // Sets the rel32 at pos to jump to the end of the code.
+   //
+   void JitWriter::putRel32(std::size_t pos)
+   {
+      Word rel = static_cast<Word>(code.size() - (pos + 4));
+      std::memcpy(&code[pos], &rel, 4);
+   }
+
+   //
+   // JitWriter::putWord
+   //
+   void JitWriter::putWord(Word w)
+   {
+      put({Byte(w), Byte(w >> 8), Byte(w >> 16), Byte(w >> 24)});
+   }
+
+   //
+   // JitWriter::stkAdd
+   //
+   void JitWriter::stkAdd(SWord n)
+   {
+      if(!n) return;
+
+      if(n >= -31 && n <= 31)
+         put({0x48, 0x83, 0xC3, Byte(n * 4)});
+      else
+         put({0x48, 0x81, 0xC3}), putWord(static_cast<Word>(n * 4));
+   }
+
+   //
+   // JitWriter::write
+   //
+   // Returns false if there is nothing to compile from root.
+   //
+   bool JitWriter::write(Word root)
+   {
+      if(root >= codeC || !pd->codeIdx[root] || !IsJitCode(getCode(root)))
+         return false;
+
+      find(root);
+
+      if(!codeJit[root])
+         return false;
+
+      // JitEnter. With the return address, the pushes and the sub keep the
+      // stack aligned for calls to JitOpFunc.
+      put({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56}); // push rbx, r12-r14
+      put({0x48, 0x83, 0xEC, 0x08});                   // sub rsp, 8
+      put({0x49, 0x89, 0xFE});                         // mov r14, rdi
+      putMem({0x8B}, EBX, R14, offsetof(JitFrame, stk), true);
+      putMem({0x8B}, R12, R14, offsetof(JitFrame, loc), true);
+      putMem({0x8B}, R13, R14, offsetof(JitFrame, branches));
+      put({0xFF, 0xE6});                               // jmp rsi
+
+      // Return, with eax already set.
+      epilogue = code.size();
+      putMem({0x89}, EBX, R14, offsetof(JitFrame, stk), true);
+      putMem({0x89}, R13, R14, offsetof(JitFrame, branches));
+      put({0x48, 0x83, 0xC4, 0x08});                   // add rsp, 8
+      put({0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B}); // pop r14-r12, rbx
+      put({0xC3});                                     // ret
+
+      labelV.assign(codeC, 0);
+
+      for(Word iter = 0; iter != codeC; ++iter)
+      {
+         if(!codeJit[iter]) continue;
+
+         labelV[iter] = code.size();
+
+         if(iter == root || codeRes[iter])
+            entries.push_back(iter);
+
+         if(!writeCode(iter))
+            continue;
+
+         Word next = iter + getCodeSize(iter);
+
+         // Continue to the next code, unless it is the next one written. Fused
+         // codes skip the remainder of the original sequence.
+         Word after = iter + 1;
+         while(after < codeC && !codeJit[after]) ++after;
+         if(after != next)
+            writeGoto(next);
+      }
+
+      for(auto &fixup : fixupV)
+      {
+         Word rel = static_cast<Word>(labelV[fixup.second] - (fixup.first + 4));
+         std::memcpy(&code[fixup.first], &rel, 4);
+      }
+
+      return !fail;
+   }
+
+   //
+   // JitWriter::writeBranch
+   //
+   // Counts a branch as Thread::exec does, then goes to target.
+   //
+   void JitWriter::writeBranch(Word target)
+   {
+      put({0x45, 0x85, 0xED});       // test r13d, r13d
+      put({0x74, 0x00});             // jz
+      std::size_t posZ = code.size();
+      put({0x41, 0xFF, 0xCD});       // dec r13d
+      put({0x75, 0x00});             // jnz
+      std::size_t posNZ = code.size();
+
+      writeExit(target, false);
+
+      code[posZ  - 1] = static_cast<Byte>(code.size() - posZ);
+      code[posNZ - 1] = static_cast<Byte>(code.size() - posNZ);
+
+      writeGoto(target);
+   }
+
+   //
+   // JitWriter::writeCode
+   //
+   // Returns false if the code does not continue to the next.
+   //
+   bool JitWriter::writeCode(Word iter)
+   {
+      Word const *c = &codeV[iter];
+
+      switch(getCode(iter))
+      {
+      case Code::Nop:
+         break;
+
+         #define ACSVM_CodeListFusedOp(name) \
+            case Code::name: \
+               loadStk(EAX, 2); loadStk(ECX, 1); writeOp(JitOp::name); \
+               storeStk(EAX, 2); stkAdd(-1); \
+               break; \
+            case Code::name##_Lit: \
+               loadStk(EAX, 1); loadImm(ECX, c[1]); writeOp(JitOp::name); \
+               storeStk(EAX, 1); \
+               break; \
+            case Code::name##_LocLit: \
+               loadLoc(EAX, c[1]); loadImm(ECX, c[3]); writeOp(JitOp::name); \
+               storeStk(EAX, 0); stkAdd(1); \
+               break; \
+            case Code::name##_LocLoc: \
+               loadLoc(EAX, c[1]); loadLoc(ECX, c[3]); writeOp(JitOp::name); \
+               storeStk(EAX, 0); stkAdd(1); \
+               break; \
+            case Code::name##_LocLit_Drop: \
+               writeOpLoc(JitOp::name, c[1], true, c[3], c[6]); \
+               break; \
+            case Code::name##_LocLoc_Drop: \
+               writeOpLoc(JitOp::name, c[1], false, c[3], c[6]); \
+               break;
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedOpSet(name) \
+            case Code::name##_LocReg: \
+               stkAdd(-1); loadStk(ECX, 0); loadLoc(EAX, c[1]); \
+               writeOp(JitOp::name); storeLoc(EAX, c[1]); \
+               break; \
+            case Code::name##_LocReg_Lit: \
+               writeOpLoc(JitOp::name, c[3], true, c[1], c[3]); \
+               break; \
+            case Code::name##_LocReg_Loc: \
+               writeOpLoc(JitOp::name, c[3], false, c[1], c[3]); \
+               break;
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedJcmp(name, inv) \
+            case Code::Jcmp##name: \
+               loadStk(EAX, 2); loadStk(ECX, 1); stkAdd(-2); \
+               writeJcc(JitCC_##name, c[2]); \
+               break; \
+            case Code::Jcmp##name##_Lit: \
+               loadStk(EAX, 1); stkAdd(-1); loadImm(ECX, c[1]); \
+               writeJcc(JitCC_##name, c[4]); \
+               break; \
+            case Code::Jcmp##name##_LocLit: \
+               loadLoc(EAX, c[1]); loadImm(ECX, c[3]); \
+               writeJcc(JitCC_##name, c[6]); \
+               break; \
+            case Code::Jcmp##name##_LocLoc: \
+               loadLoc(EAX, c[1]); loadLoc(ECX, c[3]); \
+               writeJcc(JitCC_##name, c[6]); \
+               break;
+         #include "CodeList.hpp"
+
+      case Code::DecU_LocReg:
+         putMem({0xFF}, 1, R12, locDisp(c[1]));
+         break;
+
+      case Code::IncU_LocReg:
+         putMem({0xFF}, 0, R12, locDisp(c[1]));
+         break;
+
+      case Code::Drop_Nul:
+         stkAdd(-1);
+         break;
+
+      case Code::Jcnd_Lit:
+         {
+            loadStk(EAX, 1);
+            put({0x3D}); putWord(c[1]);  // cmp eax, imm32
+            put({0x0F, 0x85, 0, 0, 0, 0}); // jne
+            std::size_t pos = code.size() - 4;
+            stkAdd(-1);
+            writeBranch(c[2]);
+            putRel32(pos);
+         }
+         break;
+
+      case Code::Jcnd_Nil:
+      case Code::Jcnd_Tru:
+         {
+            loadStk(EAX, 1);
+            stkAdd(-1);
+            put({0x85, 0xC0});             // test eax, eax
+            put({0x0F, Byte(getCode(iter) == Code::Jcnd_Nil ? 0x85 : 0x84), 0, 0, 0, 0});
+            std::size_t pos = code.size() - 4;
+            writeBranch(c[1]);
+            putRel32(pos);
+         }
+         break;
+
+      case Code::Jump_Lit:
+         writeBranch(c[1]);
+         return false;
+
+      case Code::Push_Lit:
+         putMem({0xC7}, 0, EBX, 0); putWord(c[1]);
+         stkAdd(1);
+         break;
+
+      case Code::Push_LitArr:
+         for(Word i = 0; i != c[1]; ++i)
+            putMem({0xC7}, 0, EBX, static_cast<SWord>(i * 4)), putWord(c[2 + i]);
+         stkAdd(static_cast<SWord>(c[1]));
+         break;
+
+      case Code::Push_LocReg:
+         loadLoc(EAX, c[1]); storeStk(EAX, 0); stkAdd(1);
+         break;
+
+      case Code::Copy:
+         loadStk(EAX, 1); storeStk(EAX, 0); stkAdd(1);
+         break;
+
+      case Code::Swap:
+         loadStk(EAX, 2); loadStk(ECX, 1); storeStk(ECX, 2); storeStk(EAX, 1);
+         break;
+
+      case Code::InvU:
+         putMem({0xF7}, 2, EBX, -4);
+         break;
+
+      case Code::NegI:
+         putMem({0xF7}, 3, EBX, -4);
+         break;
+
+      case Code::NotU:
+         loadStk(EAX, 1);
+         put({0x85, 0xC0, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0}); // eax = !eax
+         storeStk(EAX, 1);
+         break;
+
+      default:
+         fail = true;
+         return false;
+      }
+
+      return true;
+   }
+
+   //
+   // JitWriter::writeExit
+   //
+   // Returns to Thread::exec at idx. If cont is false, the thread has run out
+   // of branches.
+   //
+   void JitWriter::writeExit(Word idx, bool cont)
+   {
+      putMem({0xC7}, 0, R14, offsetof(JitFrame, idx)); putWord(idx);
+
+      if(cont)
+         loadImm(EAX, 1);
+      else
+         put({0x31, 0xC0}); // xor eax, eax
+
+      put({0xE9}); putWord(static_cast<Word>(epilogue - (code.size() + 4)));
+   }
+
+   //
+   // JitWriter::writeGoto
+   //
+   void JitWriter::writeGoto(Word target)
+   {
+      if(target < codeC && codeJit[target])
+      {
+         put({0xE9}); fixupV.emplace_back(code.size(), target); putWord(0);
+      }
+      else if(target < codeC && pd->entryV[target].enter)
+      {
+         // Another block, which uses the same registers.
+         auto addr = reinterpret_cast<std::uintptr_t>(pd->entryV[target].addr);
+         put({0x48, 0xB8}); // mov rax, imm64
+         putWord(static_cast<Word>(addr)); putWord(static_cast<Word>(addr >> 32));
+         put({0xFF, 0xE0}); // jmp rax
+      }
+      else
+         writeExit(target, true);
+   }
+
+   //
+   // JitWriter::writeJcc
+   //
+   // Compares eax to ecx, branching to target if the condition is met.
+   //
+   void JitWriter::writeJcc(Byte cc, Word target)
+   {
+      put({0x39, 0xC8});                           // cmp eax, ecx
+      put({0x0F, Byte(0x80 | (cc ^ 1)), 0, 0, 0, 0}); // jncc
+      std::size_t pos = code.size() - 4;
+      writeBranch(target);
+      putRel32(pos);
+   }
+
+   //
+   // JitWriter::writeOp
+   //
+   // Sets eax to the result of the operator on eax and ecx.
+   //
+   void JitWriter::writeOp(JitOp op)
+   {
+      auto cmp = [&](Byte cc)
+      {
+         put({0x39, 0xC8, 0x0F, Byte(0x90 | cc), 0xC0, 0x0F, 0xB6, 0xC0});
+      };
+
+      auto call = [&](Word (*func)(Word, Word))
+      {
+         auto addr = reinterpret_cast<std::uintptr_t>(func);
+         put({0x89, 0xC7, 0x89, 0xCE}); // mov edi, eax; mov esi, ecx
+         put({0x48, 0xB8});             // mov rax, imm64
+         putWord(static_cast<Word>(addr)); putWord(static_cast<Word>(addr >> 32));
+         put({0xFF, 0xD0});             // call rax
+      };
+
+      switch(op)
+      {
+      case JitOp::AddU: put({0x01, 0xC8}); break;
+      case JitOp::AndU: put({0x21, 0xC8}); break;
+      case JitOp::Drop: put({0x89, 0xC8}); break;
+      case JitOp::MulU: put({0x0F, 0xAF, 0xC1}); break;
+      case JitOp::OrIU: put({0x09, 0xC8}); break;
+      case JitOp::OrXU: put({0x31, 0xC8}); break;
+      case JitOp::ShLU: put({0xD3, 0xE0}); break;
+      case JitOp::ShRI: put({0xD3, 0xF8}); break;
+      case JitOp::SubU: put({0x29, 0xC8}); break;
+
+      case JitOp::CmpI_GE: cmp(JitCC_I_GE); break;
+      case JitOp::CmpI_GT: cmp(JitCC_I_GT); break;
+      case JitOp::CmpI_LE: cmp(JitCC_I_LE); break;
+      case JitOp::CmpI_LT: cmp(JitCC_I_LT); break;
+      case JitOp::CmpU_EQ: cmp(JitCC_U_EQ); break;
+      case JitOp::CmpU_NE: cmp(JitCC_U_NE); break;
+
+      case JitOp::LAnd:
+         // eax = (eax != 0) & (ecx != 0)
+         put({0x85, 0xC0, 0x0F, 0x95, 0xC0, 0x85, 0xC9, 0x0F, 0x95, 0xC1,
+            0x20, 0xC8, 0x0F, 0xB6, 0xC0});
+         break;
+
+      case JitOp::LOrI:
+         // eax = (eax | ecx) != 0
+         put({0x09, 0xC8, 0x0F, 0x95, 0xC0, 0x0F, 0xB6, 0xC0});
+         break;
+
+      case JitOp::DivI: call(JitOpFunc<OpFunc_DivI>); break;
+      case JitOp::DivX: call(JitOpFunc<OpFunc_DivX>); break;
+      case JitOp::ModI: call(JitOpFunc<OpFunc_ModI>); break;
+      case JitOp::MulX: call(JitOpFunc<OpFunc_MulX>); break;
+      }
+   }
+
+   //
+   // JitWriter::writeOpLoc
+   //
+   // Sets local register dst to the result of the operator on local register
+   // lop and either a literal or local register rop.
+   //
+   void JitWriter::writeOpLoc(JitOp op, Word lop, bool lit, Word rop, Word dst)
+   {
+      loadLoc(EAX, lop);
+
+      if(lit)
+         loadImm(ECX, rop);
+      else
+         loadLoc(ECX, rop);
+
+      writeOp(op);
+      storeLoc(EAX, dst);
+   }
+   #endif
+
+   //
+   // JitModule constructor
+   //
+   JitModule::JitModule(Module *module_) :
+      module{module_},
+
+      countV{new std::atomic<Word>[module_->codeV.size()]()},
+      countC{module_->codeV.size()},
+
+      threshold{module_->env->jitThreshold},
+
+      pd{new PrivData}
+   {
+      #if ACSVM_JitX64
+      Word const *codeV = module->codeSrcV.data();
+      std::size_t codeC = module->codeSrcV.size();
+
+      pd->codeIdx.resize(codeC);
+      pd->entryV.resize(codeC, JitEntry{nullptr, nullptr});
+
+      for(std::size_t iter = 0, next; iter != codeC; iter = next)
+      {
+         pd->codeIdx[iter] = true;
+
+         if(!(next = Optimizer::GetFusedHeadSize(static_cast<Code>(codeV[iter]))))
+            next = JitCodeSize(module, codeV, codeC, iter);
+
+         next = std::min(next + iter, codeC);
+      }
+      #endif
+   }
+
+   //
+   // JitModule destructor
+   //
+   JitModule::~JitModule()
+   {
+      #if ACSVM_JitX64
+      for(auto &block : pd->blockV)
+         munmap(block.first, block.second);
+      #endif
+
+      delete pd;
+   }
+
+   //
+   // JitModule::compile
+   //
+   void JitModule::compile()
+   {
+      std::vector<Word> pendV;
+
+      {
+         std::lock_guard<std::mutex> lock{pd->pendMutex};
+         if(pd->pendV.empty()) return;
+         std::swap(pendV, pd->pendV);
+      }
+
+      #if ACSVM_JitX64
+      for(Word root : pendV)
+      {
+         if(root >= pd->entryV.size() || pd->entryV[root].enter)
+            continue;
+
+         JitWriter writer{module, pd};
+         if(!writer.write(root))
+            continue;
+
+         // Mapped writable, then made executable once written.
+         std::size_t size = writer.code.size();
+         void *block = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+         if(block == MAP_FAILED)
+            continue;
+
+         std::memcpy(block, writer.code.data(), size);
+         if(mprotect(block, size, PROT_READ | PROT_EXEC))
+         {
+            munmap(block, size);
+            continue;
+         }
+
+         pd->blockV.emplace_back(block, size);
+
+         auto enter = reinterpret_cast<JitEnter>(block);
+         for(Word iter : writer.entries)
+         {
+            pd->entryV[iter] = {enter, static_cast<Byte const *>(block) + writer.labelV[iter]};
+            module->codeV[iter] = Thread::ExecCode(Code::Native);
+         }
+
+         module->native = JitNative;
+      }
+      #endif
+   }
+
+   //
+   // JitModule::exec
+   //
+   bool JitModule::exec(Thread *thread, Word &branches)
+   {
+      Word      idx   = thread->codePtr - module->codeV.data();
+      JitEntry &entry = pd->entryV[idx];
+      JitFrame  frame{thread->dataStk.end(), &thread->localReg[0], branches, idx};
+
+      bool cont = entry.enter(&frame, entry.addr);
+
+      thread->dataStk.setEnd(frame.stk);
+      thread->codePtr = &module->codeV[frame.idx];
+      branches        = frame.branches;
+
+      return cont;
+   }
+
+   //
+   // JitModule::pend
+   //
+   // Queues the code at idx to be compiled.
+   //
+   void JitModule::pend(Word idx)
+   {
+      std::lock_guard<std::mutex> lock{pd->pendMutex};
+      pd->pendV.push_back(idx);
+   }
+
+   //
+   // JitModule::Create
+   //
+   JitModule *JitModule::Create(Module *module)
+   {
+      #if ACSVM_JitX64
+      if(module->env->jitThreshold && !module->native)
+         return new JitModule(module);
+      #else
+      (void)module;
+      #endif
+
+      return nullptr;
+   }
+}
+
+// EOF
+
@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2017 David Hill
+//
+// See COPYING for license information.
+//
+//-----------------------------------------------------------------------------
+//
+// Runtime native code generation.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef ACSVM__Jit_H__
+#define ACSVM__Jit_H__
+
+#include "Types.hpp"
+
+#include <atomic>
+#include <memory>
+
+
+//----------------------------------------------------------------------------|
+// Types                                                                      |
+//
+
+namespace ACSVM
+{
+   //
+   // JitModule
+   //
+   // Compiles a module's hot code to machine code, which Thread::exec enters
+   // through Code::Native the same way as native code from acsvm-aot. Code is
+   // hot once a function has been called, or a code branched back to,
+   // Environment::jitThreshold times. Each such code is compiled along with
+   // everything it can reach, up to codes that are left to Thread::exec.
+   //
+   class JitModule
+   {
+   public:
+      explicit JitModule(Module *module);
+      ~JitModule();
+
+      // Compiles the code found hot since the last call. Must not be called
+      // while any thread of the module's Environment is executing.
+      void compile();
+
+      //
+      // count
+      //
+      // Counts an entry to the code at idx. Entries from different threads
+      // may be lost, but the threshold is still reached exactly once.
+      //
+      void count(Word idx)
+      {
+         if(idx >= countC) return;
+
+         Word n = countV[idx].load(std::memory_order_relaxed) + 1;
+         countV[idx].store(n, std::memory_order_relaxed);
+
+         if(n == threshold)
+            pend(idx);
+      }
+
+      // Runs compiled code from the thread's codePtr, as a NativeFunc.
+      bool exec(Thread *thread, Word &branches);
+
+      Module *const module;
+
+
+      // Returns a JitModule for module, or null if the JIT is disabled, not
+      // supported by the build, or module already has native code.
+      static JitModule *Create(Module *module);
+
+
+      friend class JitWriter;
+
+   private:
+      struct PrivData;
+
+      void pend(Word idx);
+
+      std::unique_ptr<std::atomic<Word>[]> countV;
+      std::size_t                          countC;
+
+      Word threshold;
+
+      PrivData *pd;
+   };
+}
+
+#endif//ACSVM__Jit_H__
+
@@ -14,6 +14,8 @@
 
 #include "BinaryIO.hpp"
 
+#include <algorithm>
+
 
 //----------------------------------------------------------------------------|
 // Extern Functions                                                           |
@@ -21,6 +23,69 @@
 
 namespace ACSVM
 {
+   //
+   // JumpMap::build
+   //
+   void JumpMap::build()
+   {
+      table.build();
+
+      denseV.reset(); denseMin = 0; denseC = 0;
+      sortV.reset();  sortC    = 0;
+
+      if(table.empty())
+         return;
+
+      // Case values are signed, so find the range in signed order.
+      SWord min = static_cast<SWord>(table.begin()->key), max = min;
+      for(auto &jump : table)
+      {
+         min = std::min(min, static_cast<SWord>(jump.key));
+         max = std::max(max, static_cast<SWord>(jump.key));
+      }
+
+      Word range = static_cast<Word>(max) - static_cast<Word>(min);
+
+      // Use a direct index if at least half of it would be used.
+      if(range < table.size() * 2)
+      {
+         denseMin = static_cast<Word>(min);
+         denseC   = range + 1;
+         denseV.reset(new Word *[denseC]());
+
+         // Later duplicates take precedence, as with the hash table.
+         for(auto &jump : table)
+            denseV[jump.key - denseMin] = &jump.val;
+      }
+      else
+      {
+         sortC = table.size();
+         sortV.reset(new Elem *[sortC]);
+
+         std::size_t i = 0;
+         for(auto &jump : table)
+            sortV[i++] = &jump;
+
+         std::stable_sort(sortV.get(), sortV.get() + sortC,
+            [](Elem const *l, Elem const *r) {return l->key < r->key;});
+      }
+   }
+
+   //
+   // JumpMap::findSort
+   //
+   Word *JumpMap::findSort(Word caseVal)
+   {
+      auto itr = std::upper_bound(sortV.get(), sortV.get() + sortC, caseVal,
+         [](Word key, Elem const *jump) {return key < jump->key;});
+
+      // Last of any duplicates, as with the hash table.
+      if(itr == sortV.get() || (*--itr)->key != caseVal)
+         return nullptr;
+
+      return &(*itr)->val;
+   }
+
    //
    // JumpMap::loadJumps
    //
@@ -33,10 +98,26 @@ namespace ACSVM
       {
          Word caseVal = ReadLE4(data + iter); iter += 4;
          Word codeIdx = ReadLE4(data + iter); iter += 4;
-         new(&jump) HashMapFixed<Word, Word>::Elem{caseVal, codeIdx, nullptr};
+         new(&jump) Elem{caseVal, codeIdx, nullptr};
       }
 
-      table.build();
+      build();
+   }
+
+   //
+   // JumpMap::setJumps
+   //
+   void JumpMap::setJumps(std::pair<Word, Word> const *jumps, std::size_t count)
+   {
+      table.alloc(count);
+
+      for(auto &jump : table)
+      {
+         new(&jump) Elem{jumps->first, jumps->second, nullptr};
+         ++jumps;
+      }
+
+      build();
    }
 }
 
@@ -15,6 +15,9 @@
 
 #include "HashMapFixed.hpp"
 
+#include <memory>
+#include <utility>
+
 
 //----------------------------------------------------------------------------|
 // Types                                                                      |
@@ -36,12 +39,48 @@ namespace ACSVM
    //
    // JumpMap
    //
+   // Case values are looked up through a directly indexed array if they are
+   // dense enough, or by binary search otherwise. Both refer to the elements
+   // of table, so its code indexes can still be changed after loading.
+   //
    class JumpMap
    {
    public:
+      JumpMap() : denseMin{0}, denseC{0}, sortC{0} {}
+
+      //
+      // find
+      //
+      // Returns the code index for caseVal, or null if there is none.
+      //
+      Word *find(Word caseVal)
+      {
+         if(denseV)
+            return caseVal - denseMin < denseC ? denseV[caseVal - denseMin] : nullptr;
+
+         return sortC ? findSort(caseVal) : nullptr;
+      }
+
       void loadJumps(Byte const *data, std::size_t count);
 
+      // Sets jumps from case value and code index pairs.
+      void setJumps(std::pair<Word, Word> const *jumps, std::size_t count);
+
       HashMapFixed<Word, Word> table;
+
+   private:
+      using Elem = HashMapFixed<Word, Word>::Elem;
+
+      void build();
+
+      Word *findSort(Word caseVal);
+
+      std::unique_ptr<Word *[]> denseV;
+      Word                      denseMin;
+      Word                      denseC;
+
+      std::unique_ptr<Elem *[]> sortV;
+      std::size_t               sortC;
    };
 }
 
@@ -16,6 +16,7 @@
 #include "Environment.hpp"
 #include "Function.hpp"
 #include "Init.hpp"
+#include "Jit.hpp"
 #include "Jump.hpp"
 #include "Script.hpp"
 
@@ -43,6 +44,10 @@ namespace ACSVM
 
       hashLink{this},
 
+      native  {nullptr},
+      codeHash{0},
+      jit     {nullptr},
+
       isACS0{false},
       loaded{false}
    {
@@ -95,6 +100,7 @@ namespace ACSVM
       arrNameV.free();
       arrSizeV.free();
       codeV.free();
+      codeSrcV.free();
       funcNameV.free();
       functionV.free();
       importV.free();
@@ -107,6 +113,12 @@ namespace ACSVM
       scriptV.free();
       stringV.free();
 
+      delete jit;
+
+      native   = nullptr;
+      codeHash = 0;
+      jit      = nullptr;
+
       isACS0 = false;
       loaded = false;
    }
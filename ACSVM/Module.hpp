@@ -85,6 +85,7 @@ namespace ACSVM
       Vector<String *>   arrNameV;
       Vector<Word>       arrSizeV;
       Vector<Word>       codeV;
+      Vector<Word>       codeSrcV; // codeV before encoding, as hashed.
       Vector<String *>   funcNameV;
       Vector<Function *> functionV;
       Vector<Module *>   importV;
@@ -99,6 +100,10 @@ namespace ACSVM
 
       ListLink<Module> hashLink;
 
+      NativeFunc native;   // Registered native code, if any.
+      Word       codeHash; // Hash of translated code, see Environment::addNative.
+      JitModule *jit;      // Runtime native code, see Environment::jitThreshold.
+
       bool isACS0;
       bool loaded;
 
@@ -16,6 +16,7 @@
 #include "Environment.hpp"
 #include "Error.hpp"
 #include "Jump.hpp"
+#include "Optimizer.hpp"
 #include "Script.hpp"
 #include "Tracer.hpp"
 
@@ -103,6 +104,7 @@ namespace ACSVM
          scr.argC    = ReadLE4(data + iter); iter += 4;
 
          std::tie(scr.type, scr.name.i) = env->getScriptTypeACS0(scr.name.i);
+         scr.priority = env->getScriptPriority(scr.type);
       }
 
       // Read string table.
@@ -138,6 +140,8 @@ namespace ACSVM
       jumpMapV.alloc(tracer.jumpMapC);
 
       tracer.translate(this);
+
+      Optimizer{env, this}.optimize();
    }
 
    //
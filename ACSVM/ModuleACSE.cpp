@@ -268,8 +268,14 @@ namespace ACSVM
       std::size_t arrC = (size - 2) / 4;
 
       if(idx < functionV.size() && functionV[idx])
+      {
          functionV[idx]->locArrC = arrC;
 
+         functionV[idx]->locArrSizeV.alloc(arrC);
+         for(std::size_t i = 0; i != arrC; ++i)
+            functionV[idx]->locArrSizeV[i] = ReadLE4(data + 2 + i * 4);
+      }
+
       return false;
    }
 
@@ -490,7 +496,15 @@ namespace ACSVM
       if(nameInt & 0x8000) nameInt |= 0xFFFF0000;
 
       for(Script &scr : scriptV)
-         if(scr.name.i == nameInt) scr.locArrC = arrC;
+      {
+         if(scr.name.i != nameInt) continue;
+
+         scr.locArrC = arrC;
+
+         scr.locArrSizeV.alloc(arrC);
+         for(std::size_t i = 0; i != arrC; ++i)
+            scr.locArrSizeV[i] = ReadLE4(data + 2 + i * 4);
+      }
 
       return false;
    }
@@ -804,7 +818,7 @@ namespace ACSVM
       chunkIterACSE(data, size, &Module::chunkerACSE_MSTR);
 
       for(auto &init : arrInitV)
-         init.finish();
+         init.finish(this);
    }
 
    //
@@ -821,7 +835,8 @@ namespace ACSVM
             scr->name.s = scrNameV[nameIdx];
       }
 
-      scr->type = env->getScriptTypeACSE(type);
+      scr->type     = env->getScriptTypeACSE(type);
+      scr->priority = env->getScriptPriority(scr->type);
    }
 
    //
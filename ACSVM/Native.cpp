@@ -0,0 +1,574 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2015-2017 David Hill
+//
+// See COPYING for license information.
+//
+//-----------------------------------------------------------------------------
+//
+// Native code generation.
+//
+//-----------------------------------------------------------------------------
+
+#include "Native.hpp"
+
+#include "Code.hpp"
+#include "CodeData.hpp"
+#include "Environment.hpp"
+#include "Module.hpp"
+#include "Optimizer.hpp"
+#include "String.hpp"
+#include "Thread.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+
+//----------------------------------------------------------------------------|
+// Types                                                                      |
+//
+
+namespace ACSVM
+{
+   //
+   // NativeOpSet
+   //
+   // Describes a code that operates on a variable.
+   //
+   struct NativeOpSet
+   {
+      char const *op;    // Operator function, or null for unary codes.
+      char const *unary; // Unary operator.
+      char const *first; // Variable before index.
+      char const *last;  // Variable after index.
+      bool        arr;   // Variable is an array element.
+   };
+
+   //
+   // NativeWriter
+   //
+   class NativeWriter
+   {
+   public:
+      NativeWriter(std::ostream &out, Module const *module);
+
+      void write(char const *name);
+
+   private:
+      void writeBranch(Word target);
+
+      void writeCode(std::size_t iter);
+
+      void writeGoto(Word target);
+
+      void writeOpSet(NativeOpSet const &set, Word idx);
+
+      Code getCode(std::size_t iter) {return static_cast<Code>(codeV[iter]);}
+
+      std::size_t getCodeSize(std::size_t iter);
+
+      bool isNative(std::size_t iter);
+
+      std::ostream      &out;
+      std::ostringstream body;
+      Module const      *module;
+
+      std::vector<Word> codeV;   // Translated code, before encoding.
+      std::vector<bool> codeIdx; // Set for each index that starts a code.
+
+      bool useBranch;
+      bool useKill;
+      bool useLoc;
+   };
+}
+
+
+//----------------------------------------------------------------------------|
+// Static Functions                                                           |
+//
+
+namespace ACSVM
+{
+   //
+   // GetNativeOpSet
+   //
+   static bool GetNativeOpSet(Code code, NativeOpSet &set)
+   {
+      switch(code)
+      {
+         #define ACSVM_NativeOpSetScope(name, op, unary) \
+            case Code::name##_GblArr: set = {op, unary, "thread->scopeGbl->arrV[", "]", true}; return true; \
+            case Code::name##_GblReg: set = {op, unary, "thread->scopeGbl->regV[", "]", false}; return true; \
+            case Code::name##_HubArr: set = {op, unary, "thread->scopeHub->arrV[", "]", true}; return true; \
+            case Code::name##_HubReg: set = {op, unary, "thread->scopeHub->regV[", "]", false}; return true; \
+            case Code::name##_LocArr: set = {op, unary, "thread->localArr[", "]", true}; return true; \
+            case Code::name##_LocReg: set = {op, unary, "loc[", "]", false}; return true; \
+            case Code::name##_ModArr: set = {op, unary, "(*thread->scopeMod->arrV[", "])", true}; return true; \
+            case Code::name##_ModReg: set = {op, unary, "*thread->scopeMod->regV[", "]", false}; return true;
+
+         #define ACSVM_CodeListFusedOpSet(name) \
+            ACSVM_NativeOpSetScope(name, "OpFunc_" #name, nullptr)
+         #include "CodeList.hpp"
+
+         ACSVM_NativeOpSetScope(DecU, nullptr, "--")
+         ACSVM_NativeOpSetScope(IncU, nullptr, "++")
+
+         #undef ACSVM_NativeOpSetScope
+
+      default:
+         return false;
+      }
+   }
+}
+
+
+//----------------------------------------------------------------------------|
+// Extern Functions                                                           |
+//
+
+namespace ACSVM
+{
+   //
+   // NativeWriter constructor
+   //
+   NativeWriter::NativeWriter(std::ostream &out_, Module const *module_) :
+      out   {out_},
+      module{module_},
+
+      codeV  (module_->codeSrcV.begin(), module_->codeSrcV.end()),
+      codeIdx(module_->codeSrcV.size()),
+
+      useBranch{false},
+      useKill  {false},
+      useLoc   {false}
+   {
+      for(std::size_t iter = 0, end = codeV.size(), next; iter != end; iter = next)
+      {
+         codeIdx[iter] = true;
+
+         if(!(next = Optimizer::GetFusedHeadSize(getCode(iter))))
+            next = getCodeSize(iter);
+
+         next = std::min(next + iter, end);
+      }
+   }
+
+   //
+   // NativeWriter::getCodeSize
+   //
+   std::size_t NativeWriter::getCodeSize(std::size_t iter)
+   {
+      switch(Code code = getCode(iter))
+      {
+      case Code::CallFunc_Lit:
+      case Code::CallSpec_Lit:
+         return iter + 1 < codeV.size() ? 3 + codeV[iter + 1] : 1;
+
+      case Code::Push_LitArr:
+         return iter + 1 < codeV.size() ? 2 + codeV[iter + 1] : 1;
+
+      default:
+         return 1 + module->env->getCodeData(code)->argc;
+      }
+   }
+
+   //
+   // NativeWriter::isNative
+   //
+   // Returns true if the code at iter is written as native code. Only these
+   // codes get a label and an entry in the dispatch switch.
+   //
+   bool NativeWriter::isNative(std::size_t iter)
+   {
+      return iter < codeIdx.size() && codeIdx[iter] &&
+         IsNativeCode(getCode(iter)) && iter + getCodeSize(iter) <= codeV.size();
+   }
+
+   //
+   // NativeWriter::write
+   //
+   void NativeWriter::write(char const *name)
+   {
+      for(std::size_t iter = 0, end = codeV.size(); iter != end; ++iter)
+      {
+         if(codeIdx[iter])
+            writeCode(iter);
+      }
+
+      out << "//\n// " << name << "\n//\n";
+      if(module->name.s)
+         out << "// " << module->name.s->str << "\n//\n";
+
+      out << "static bool " << name << "(ACSVM::Thread *thread, ACSVM::Word &branches)\n{\n";
+      out << "   using namespace ACSVM;\n\n";
+      out << "   Word  idx = thread->codePtr - thread->module->codeV.data();\n";
+      out << "   Word *stk = thread->dataStk.end();\n";
+      if(useLoc)
+         out << "   Word *loc = &thread->localReg[0];\n";
+
+      out << '\n';
+      if(useBranch)
+         out << "dispatch:\n";
+      out << "   switch(idx)\n   {\n";
+      for(std::size_t iter = 0, end = codeV.size(); iter != end; ++iter)
+      {
+         if(isNative(iter))
+            out << "   case " << iter << ": goto L" << iter << ";\n";
+      }
+      out << "   default: goto exit;\n   }\n\n";
+
+      out << body.str();
+
+      out << "\nexit:\n";
+      out << "   thread->dataStk.setEnd(stk);\n";
+      out << "   thread->codePtr = &thread->module->codeV[idx];\n";
+      out << "   return true;\n";
+
+      if(useBranch)
+      {
+         out << "\nbranch:\n";
+         out << "   if(branches && !--branches) goto kill;\n";
+         out << "   goto dispatch;\n";
+      }
+
+      if(useKill)
+      {
+         out << "\nkill:\n";
+         out << "   thread->dataStk.setEnd(stk);\n";
+         out << "   thread->codePtr = &thread->module->codeV[idx];\n";
+         out << "   return false;\n";
+      }
+
+      out << "}\n\n";
+
+      // Write the code as it was hashed, for addNative to compare against.
+      out << "//\n// " << name << "_Code\n//\n";
+      out << "static ACSVM::Word const " << name << "_Code[] =\n{";
+      for(std::size_t iter = 0, end = codeV.size(); iter != end; ++iter)
+         out << (iter % 8 ? " " : "\n   ") << codeV[iter] << "u,";
+      if(codeV.empty())
+         out << "\n   0u,";
+      out << "\n};\n\n";
+   }
+
+   //
+   // NativeWriter::writeBranch
+   //
+   void NativeWriter::writeBranch(Word target)
+   {
+      useKill = true;
+
+      body << "{if(branches && !--branches) {idx = " << target << "; goto kill;} ";
+      writeGoto(target);
+      body << '}';
+   }
+
+   //
+   // NativeWriter::writeCode
+   //
+   void NativeWriter::writeCode(std::size_t iter)
+   {
+      // Only reached by falling through from the previous code.
+      if(!isNative(iter))
+      {
+         body << "   idx = " << iter << "; goto exit;\n";
+         return;
+      }
+
+      body << "L" << iter << ": ";
+
+      Code        code = getCode(iter);
+      std::size_t size = getCodeSize(iter);
+      Word const *c    = &codeV[iter];
+
+      NativeOpSet set;
+      if(GetNativeOpSet(code, set))
+      {
+         writeOpSet(set, c[1]);
+         body << '\n';
+         return;
+      }
+
+      switch(code)
+      {
+      case Code::Nop:
+         body << ';';
+         break;
+
+         #define ACSVM_CodeListFusedOp(name) \
+            case Code::name: \
+               body << "--stk; OpFunc_" #name "(stk[-1], stk[0]);"; \
+               break; \
+            case Code::name##_Lit: \
+               body << "OpFunc_" #name "(stk[-1], " << c[1] << "u);"; \
+               break; \
+            case Code::name##_LocLit: \
+               useLoc = true; \
+               body << "*stk++ = loc[" << c[1] << "]; OpFunc_" #name "(stk[-1], " << c[3] << "u);"; \
+               break; \
+            case Code::name##_LocLoc: \
+               useLoc = true; \
+               body << "*stk++ = loc[" << c[1] << "]; OpFunc_" #name "(stk[-1], loc[" << c[3] << "]);"; \
+               break; \
+            case Code::name##_LocLit_Drop: \
+               useLoc = true; \
+               body << "{Word lop = loc[" << c[1] << "]; OpFunc_" #name "(lop, " << c[3] << "u); " \
+                  "loc[" << c[6] << "] = lop;}"; \
+               break; \
+            case Code::name##_LocLoc_Drop: \
+               useLoc = true; \
+               body << "{Word lop = loc[" << c[1] << "]; OpFunc_" #name "(lop, loc[" << c[3] << "]); " \
+                  "loc[" << c[6] << "] = lop;}"; \
+               break;
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedOpSet(name) \
+            case Code::name##_LocReg_Lit: \
+               useLoc = true; \
+               body << "OpFunc_" #name "(loc[" << c[3] << "], " << c[1] << "u);"; \
+               break; \
+            case Code::name##_LocReg_Loc: \
+               useLoc = true; \
+               body << "OpFunc_" #name "(loc[" << c[3] << "], loc[" << c[1] << "]);"; \
+               break;
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedJcmp(name, inv) \
+            case Code::Jcmp##name: \
+               body << "stk -= 2; {Word lop = stk[0]; OpFunc_Cmp" #name "(lop, stk[1]); if(lop) "; \
+               writeBranch(c[2]); body << '}'; \
+               break; \
+            case Code::Jcmp##name##_Lit: \
+               body << "--stk; {Word lop = stk[0]; OpFunc_Cmp" #name "(lop, " << c[1] << "u); if(lop) "; \
+               writeBranch(c[4]); body << '}'; \
+               break; \
+            case Code::Jcmp##name##_LocLit: \
+               useLoc = true; \
+               body << "{Word lop = loc[" << c[1] << "]; OpFunc_Cmp" #name "(lop, " << c[3] << "u); if(lop) "; \
+               writeBranch(c[6]); body << '}'; \
+               break; \
+            case Code::Jcmp##name##_LocLoc: \
+               useLoc = true; \
+               body << "{Word lop = loc[" << c[1] << "]; OpFunc_Cmp" #name "(lop, loc[" << c[3] << "]); if(lop) "; \
+               writeBranch(c[6]); body << '}'; \
+               break;
+         #include "CodeList.hpp"
+
+      case Code::Drop_Nul:
+         body << "--stk;";
+         break;
+
+      case Code::Drop_ScrRet:
+         body << "thread->result = *--stk;";
+         break;
+
+      case Code::Jcnd_Lit:
+         body << "if(stk[-1] == " << c[1] << "u) {--stk; ";
+         writeBranch(c[2]);
+         body << '}';
+         break;
+
+      case Code::Jcnd_Nil:
+         body << "if(!*--stk) ";
+         writeBranch(c[1]);
+         break;
+
+      case Code::Jcnd_Tab:
+         useBranch = useKill = true;
+         body << "if(auto jump = thread->module->jumpMapV[" << c[1] << "].find(stk[-1])) "
+            "{--stk; idx = *jump; goto branch;}";
+         break;
+
+      case Code::Jcnd_Tru:
+         body << "if(*--stk) ";
+         writeBranch(c[1]);
+         break;
+
+      case Code::Jump_Lit:
+         writeBranch(c[1]);
+         break;
+
+      case Code::Jump_Stk:
+         useBranch = useKill = true;
+         body << "--stk; idx = stk[0] < thread->module->jumpV.size() ? "
+            "thread->module->jumpV[stk[0]].codeIdx : 0; goto branch;";
+         break;
+
+      case Code::Pfun_Lit:
+         body << "*stk++ = " << c[1] << "u < thread->module->functionV.size() ? "
+            "thread->module->functionV[" << c[1] << "]->idx : 0;";
+         break;
+
+      case Code::Pstr_Stk:
+         body << "if(stk[-1] < thread->module->stringV.size()) "
+            "stk[-1] = ~thread->module->stringV[stk[-1]]->idx;";
+         break;
+
+      case Code::Push_GblArr:
+         body << "stk[-1] = thread->scopeGbl->arrV[" << c[1] << "].find(stk[-1]);";
+         break;
+
+      case Code::Push_GblReg:
+         body << "*stk++ = thread->scopeGbl->regV[" << c[1] << "];";
+         break;
+
+      case Code::Push_HubArr:
+         body << "stk[-1] = thread->scopeHub->arrV[" << c[1] << "].find(stk[-1]);";
+         break;
+
+      case Code::Push_HubReg:
+         body << "*stk++ = thread->scopeHub->regV[" << c[1] << "];";
+         break;
+
+      case Code::Push_Lit:
+         body << "*stk++ = " << c[1] << "u;";
+         break;
+
+      case Code::Push_LitArr:
+         body << ';';
+         for(Word i = 0; i != c[1]; ++i)
+            body << " *stk++ = " << c[2 + i] << "u;";
+         break;
+
+      case Code::Push_LocArr:
+         body << "stk[-1] = thread->localArr[" << c[1] << "].find(stk[-1]);";
+         break;
+
+      case Code::Push_LocReg:
+         useLoc = true;
+         body << "*stk++ = loc[" << c[1] << "];";
+         break;
+
+      case Code::Push_ModArr:
+         body << "stk[-1] = thread->scopeMod->arrV[" << c[1] << "]->find(stk[-1]);";
+         break;
+
+      case Code::Push_ModReg:
+         body << "*stk++ = *thread->scopeMod->regV[" << c[1] << "];";
+         break;
+
+      case Code::Push_StrArs:
+         body << "--stk; stk[-1] = thread->scopeMap->getString(stk[-1])->get(stk[0]);";
+         break;
+
+      case Code::Copy:
+         body << "stk[0] = stk[-1]; ++stk;";
+         break;
+
+      case Code::Swap:
+         body << "std::swap(stk[-2], stk[-1]);";
+         break;
+
+      case Code::InvU:
+         body << "stk[-1] = ~stk[-1];";
+         break;
+
+      case Code::NegI:
+         body << "stk[-1] = ~stk[-1] + 1;";
+         break;
+
+      case Code::NotU:
+         body << "stk[-1] = !stk[-1];";
+         break;
+
+      default:
+         body << "idx = " << iter << "; goto exit;";
+         break;
+      }
+
+      // Fused codes skip the remainder of the original sequence.
+      if(Optimizer::GetFusedHeadSize(code))
+      {
+         body << ' ';
+         writeGoto(iter + size);
+      }
+
+      body << '\n';
+   }
+
+   //
+   // NativeWriter::writeGoto
+   //
+   void NativeWriter::writeGoto(Word target)
+   {
+      if(isNative(target))
+         body << "goto L" << target << ';';
+      else
+         body << "idx = " << target << "; goto exit;";
+   }
+
+   //
+   // NativeWriter::writeOpSet
+   //
+   void NativeWriter::writeOpSet(NativeOpSet const &set, Word idx)
+   {
+      // Only LocReg uses loc, see GetNativeOpSet.
+      if(set.first[0] == 'l')
+         useLoc = true;
+
+      if(set.arr)
+      {
+         if(set.op)
+         {
+            body << "stk -= 2; " << set.op << '(' << set.first << idx << set.last
+               << "[stk[0]], stk[1]);";
+         }
+         else
+            body << "--stk; " << set.unary << set.first << idx << set.last << "[stk[0]];";
+      }
+      else
+      {
+         if(set.op)
+            body << set.op << '(' << set.first << idx << set.last << ", *--stk);";
+         else
+            body << set.unary << set.first << idx << set.last << ';';
+      }
+   }
+
+   //
+   // IsNativeCode
+   //
+   bool IsNativeCode(Code code)
+   {
+      switch(code)
+      {
+      case Code::Kill:
+      case Code::Call_Bnd:
+      case Code::Call_Lit:
+      case Code::Call_Stk:
+      case Code::CallFunc:
+      case Code::CallFunc_Lit:
+      case Code::CallSpec:
+      case Code::CallSpec_Lit:
+      case Code::CallSpec_R1:
+      case Code::Retn:
+      case Code::ScrDelay:
+      case Code::ScrDelay_Lit:
+      case Code::ScrHalt:
+      case Code::ScrRestart:
+      case Code::ScrTerm:
+      case Code::ScrWaitI:
+      case Code::ScrWaitI_Lit:
+      case Code::ScrWaitS:
+      case Code::ScrWaitS_Lit:
+      case Code::Native:
+      case Code::None:
+         return false;
+
+      default:
+         return true;
+      }
+   }
+
+   //
+   // WriteNative
+   //
+   void WriteNative(std::ostream &out, Module const *module, char const *name)
+   {
+      NativeWriter{out, module}.write(name);
+   }
+}
+
+// EOF
+
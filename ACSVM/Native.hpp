@@ -0,0 +1,39 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2015-2017 David Hill
+//
+// See COPYING for license information.
+//
+//-----------------------------------------------------------------------------
+//
+// Native code generation.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef ACSVM__Native_H__
+#define ACSVM__Native_H__
+
+#include "Types.hpp"
+
+#include <ostream>
+
+
+//----------------------------------------------------------------------------|
+// Extern Functions                                                           |
+//
+
+namespace ACSVM
+{
+   // Returns true if code is run by native code. Other codes return control
+   // to Thread::exec.
+   bool IsNativeCode(Code code);
+
+   // Writes a module's translated code as a C++ function named name, which
+   // can then be registered with Environment::addNative. The code itself is
+   // written as an array named name followed by _Code, to be passed along with
+   // it.
+   void WriteNative(std::ostream &out, Module const *module, char const *name);
+}
+
+#endif//ACSVM__Native_H__
+
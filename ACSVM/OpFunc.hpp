@@ -0,0 +1,199 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2015-2017 David Hill
+//
+// See COPYING for license information.
+//
+//-----------------------------------------------------------------------------
+//
+// Operator functions shared by Thread::exec and native code.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef ACSVM__OpFunc_H__
+#define ACSVM__OpFunc_H__
+
+#include "Types.hpp"
+
+
+//----------------------------------------------------------------------------|
+// Extern Functions                                                           |
+//
+
+namespace ACSVM
+{
+   //
+   // OpFunc_AddU
+   //
+   inline void OpFunc_AddU(Word &lop, Word rop)
+   {
+      lop += rop;
+   }
+
+   //
+   // OpFunc_AndU
+   //
+   inline void OpFunc_AndU(Word &lop, Word rop)
+   {
+      lop &= rop;
+   }
+
+   //
+   // OpFunc_CmpI_GE
+   //
+   inline void OpFunc_CmpI_GE(Word &lop, Word rop)
+   {
+      lop = static_cast<SWord>(lop) >= static_cast<SWord>(rop);
+   }
+
+   //
+   // OpFunc_CmpI_GT
+   //
+   inline void OpFunc_CmpI_GT(Word &lop, Word rop)
+   {
+      lop = static_cast<SWord>(lop) > static_cast<SWord>(rop);
+   }
+
+   //
+   // OpFunc_CmpI_LE
+   //
+   inline void OpFunc_CmpI_LE(Word &lop, Word rop)
+   {
+      lop = static_cast<SWord>(lop) <= static_cast<SWord>(rop);
+   }
+
+   //
+   // OpFunc_CmpI_LT
+   //
+   inline void OpFunc_CmpI_LT(Word &lop, Word rop)
+   {
+      lop = static_cast<SWord>(lop) < static_cast<SWord>(rop);
+   }
+
+   //
+   // OpFunc_CmpU_EQ
+   //
+   inline void OpFunc_CmpU_EQ(Word &lop, Word rop)
+   {
+      lop = lop == rop;
+   }
+
+   //
+   // OpFunc_CmpU_NE
+   //
+   inline void OpFunc_CmpU_NE(Word &lop, Word rop)
+   {
+      lop = lop != rop;
+   }
+
+   //
+   // OpFunc_DivI
+   //
+   inline void OpFunc_DivI(Word &lop, Word rop)
+   {
+      lop = rop ? static_cast<SWord>(lop) / static_cast<SWord>(rop) : 0;
+   }
+
+   //
+   // OpFunc_DivX
+   //
+   inline void OpFunc_DivX(Word &lop, Word rop)
+   {
+      if(rop)
+         lop = (SDWord(SWord(lop)) << 16) / SWord(rop);
+      else
+         lop = 0;
+   }
+
+   //
+   // OpFunc_Drop
+   //
+   inline void OpFunc_Drop(Word &lop, Word rop)
+   {
+      lop = rop;
+   }
+
+   //
+   // OpFunc_LAnd
+   //
+   inline void OpFunc_LAnd(Word &lop, Word rop)
+   {
+      lop = lop && rop;
+   }
+
+   //
+   // OpFunc_LOrI
+   //
+   inline void OpFunc_LOrI(Word &lop, Word rop)
+   {
+      lop = lop || rop;
+   }
+
+   //
+   // OpFunc_ModI
+   //
+   inline void OpFunc_ModI(Word &lop, Word rop)
+   {
+      lop = rop ? static_cast<SWord>(lop) % static_cast<SWord>(rop) : 0;
+   }
+
+   //
+   // OpFunc_MulU
+   //
+   inline void OpFunc_MulU(Word &lop, Word rop)
+   {
+      lop *= rop;
+   }
+
+   //
+   // OpFunc_MulX
+   //
+   inline void OpFunc_MulX(Word &lop, Word rop)
+   {
+      lop = DWord(SDWord(SWord(lop)) * SWord(rop)) >> 16;
+   }
+
+   //
+   // OpFunc_OrIU
+   //
+   inline void OpFunc_OrIU(Word &lop, Word rop)
+   {
+      lop |= rop;
+   }
+
+   //
+   // OpFunc_OrXU
+   //
+   inline void OpFunc_OrXU(Word &lop, Word rop)
+   {
+      lop ^= rop;
+   }
+
+   //
+   // OpFunc_ShLU
+   //
+   inline void OpFunc_ShLU(Word &lop, Word rop)
+   {
+      lop <<= rop & 31;
+   }
+
+   //
+   // OpFunc_ShRI
+   //
+   inline void OpFunc_ShRI(Word &lop, Word rop)
+   {
+      // TODO: Implement this without relying on sign-extending shift.
+      lop = static_cast<SWord>(lop) >> (rop & 31);
+   }
+
+   //
+   // OpFunc_SubU
+   //
+   inline void OpFunc_SubU(Word &lop, Word rop)
+   {
+      lop -= rop;
+   }
+}
+
+#endif//ACSVM__OpFunc_H__
+
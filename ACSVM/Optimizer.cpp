@@ -0,0 +1,1129 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2015-2017 David Hill
+//
+// See COPYING for license information.
+//
+//-----------------------------------------------------------------------------
+//
+// Optimizer classes.
+//
+//-----------------------------------------------------------------------------
+
+#include "Optimizer.hpp"
+
+#include "Code.hpp"
+#include "CodeData.hpp"
+#include "Environment.hpp"
+#include "Function.hpp"
+#include "Jit.hpp"
+#include "Jump.hpp"
+#include "Module.hpp"
+#include "Native.hpp"
+#include "OpFunc.hpp"
+#include "Script.hpp"
+#include "Thread.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+
+//----------------------------------------------------------------------------|
+// Types                                                                      |
+//
+
+namespace ACSVM
+{
+   //
+   // FusedJcmp
+   //
+   // Compare-and-branch codes for each operand source.
+   //
+   struct FusedJcmp
+   {
+      Code stk;
+      Code lit;
+      Code locLit;
+      Code locLoc;
+   };
+
+   //
+   // StackTracer
+   //
+   // Finds the stack use of functions and scripts by following every path
+   // through their code. Calls are only followed into functions of the same
+   // module, so any other call makes the caller's stack use unbounded. As in
+   // Thread::exec, a single frame is assumed to never use more than
+   // Thread::DataStkSize words, which is used when its depth cannot be found.
+   //
+   class StackTracer
+   {
+   public:
+      //
+      // Info
+      //
+      struct Info
+      {
+         Info() : callC{0}, dataC{0}, retnC{0}, bound{true}, busy{false} {}
+
+         Word callC; // Call frames used.
+         Word dataC; // Data stack words used.
+         Word retnC; // Data stack words left on return.
+         bool bound;
+         bool busy;
+      };
+
+
+      explicit StackTracer(Optimizer *opt);
+
+      Info traceCode(Word entry, Script const *script);
+
+      Info const &traceFunc(Function *func);
+
+      Optimizer *const opt;
+      Module    *const module;
+
+      // For each Call_Lit reached, 1 if only reached by bounded code.
+      std::vector<char> calls;
+
+   private:
+      std::unordered_map<Function *, Info> funcs;
+   };
+}
+
+
+//----------------------------------------------------------------------------|
+// Static Functions                                                           |
+//
+
+namespace ACSVM
+{
+   //
+   // GetFusedJcmp
+   //
+   // Returns the codes for cmp followed by jcnd.
+   //
+   static FusedJcmp GetFusedJcmp(Code cmp, Code jcnd)
+   {
+      switch(cmp)
+      {
+         #define ACSVM_CodeListFusedJcmp(name, inv) case Code::Cmp##name: \
+            if(jcnd == Code::Jcnd_Tru) return {Code::Jcmp##name, \
+               Code::Jcmp##name##_Lit, Code::Jcmp##name##_LocLit, Code::Jcmp##name##_LocLoc}; \
+            if(jcnd == Code::Jcnd_Nil) return {Code::Jcmp##inv, \
+               Code::Jcmp##inv##_Lit, Code::Jcmp##inv##_LocLit, Code::Jcmp##inv##_LocLoc}; \
+            break;
+         #include "CodeList.hpp"
+
+      default: break;
+      }
+
+      return {Code::None, Code::None, Code::None, Code::None};
+   }
+
+   //
+   // FoldOp
+   //
+   // Applies the operator of code to lop and rop, returning false if code is
+   // not a foldable operator. Divisions by zero or of the lowest value by -1
+   // are also not folded, so that they are left to the same handling as at
+   // run time instead of trapping during loading.
+   //
+   static bool FoldOp(Code code, Word &lop, Word rop)
+   {
+      switch(code)
+      {
+      case Code::DivI:
+      case Code::DivX:
+      case Code::ModI:
+         if(!rop || (lop == 0x80000000 && rop == 0xFFFFFFFF))
+            return false;
+         break;
+
+      default:
+         break;
+      }
+
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) \
+            case Code::name: OpFunc_##name(lop, rop); return true;
+         #include "CodeList.hpp"
+
+      default: return false;
+      }
+   }
+
+   //
+   // FoldUnary
+   //
+   // Applies the unary operator of code to op, returning false if code is not
+   // a foldable unary operator.
+   //
+   static bool FoldUnary(Code code, Word &op)
+   {
+      switch(code)
+      {
+      case Code::InvU: op = ~op;     return true;
+      case Code::NegI: op = ~op + 1; return true;
+      case Code::NotU: op = !op;     return true;
+
+      default: return false;
+      }
+   }
+
+   //
+   // GetFusedLit
+   //
+   // Returns the code for Push_Lit followed by code.
+   //
+   static Code GetFusedLit(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) case Code::name: return Code::name##_Lit;
+         #include "CodeList.hpp"
+
+      default: return Code::None;
+      }
+   }
+
+   //
+   // GetFusedLocLit
+   //
+   // Returns the code for Push_LocReg and Push_Lit followed by code.
+   //
+   static Code GetFusedLocLit(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) case Code::name: return Code::name##_LocLit;
+         #include "CodeList.hpp"
+
+      default: return Code::None;
+      }
+   }
+
+   //
+   // GetFusedLocLoc
+   //
+   // Returns the code for two Push_LocReg followed by code.
+   //
+   static Code GetFusedLocLoc(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) case Code::name: return Code::name##_LocLoc;
+         #include "CodeList.hpp"
+
+      default: return Code::None;
+      }
+   }
+
+   //
+   // GetFusedLocLitDrop
+   //
+   // Returns the code for Push_LocReg and Push_Lit followed by code and then
+   // Drop_LocReg.
+   //
+   static Code GetFusedLocLitDrop(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) case Code::name: return Code::name##_LocLit_Drop;
+         #include "CodeList.hpp"
+
+      default: return Code::None;
+      }
+   }
+
+   //
+   // GetFusedLocLocDrop
+   //
+   // Returns the code for two Push_LocReg followed by code and then
+   // Drop_LocReg.
+   //
+   static Code GetFusedLocLocDrop(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) case Code::name: return Code::name##_LocLoc_Drop;
+         #include "CodeList.hpp"
+
+      default: return Code::None;
+      }
+   }
+
+   //
+   // GetFusedLocRegLit
+   //
+   // Returns the code for Push_Lit followed by code, which must be _LocReg.
+   //
+   static Code GetFusedLocRegLit(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOpSet(name) \
+            case Code::name##_LocReg: return Code::name##_LocReg_Lit;
+         #include "CodeList.hpp"
+
+      default: return Code::None;
+      }
+   }
+
+   //
+   // GetFusedLocRegLoc
+   //
+   // Returns the code for Push_LocReg followed by code, which must be _LocReg.
+   //
+   static Code GetFusedLocRegLoc(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOpSet(name) \
+            case Code::name##_LocReg: return Code::name##_LocReg_Loc;
+         #include "CodeList.hpp"
+
+      default: return Code::None;
+      }
+   }
+
+   //
+   // GetJumpArg
+   //
+   // Returns the offset of the branch target in code, or 0 if none.
+   //
+   static std::size_t GetJumpArg(Code code)
+   {
+      switch(code)
+      {
+      case Code::Jcnd_Lit: return 2;
+      case Code::Jcnd_Nil: return 1;
+      case Code::Jcnd_Tru: return 1;
+      case Code::Jump_Lit: return 1;
+
+      default: return 0;
+      }
+   }
+
+   //
+   // GetStackEffect
+   //
+   // Gets the number of words code pops from and then pushes to the data
+   // stack. Returns false for codes that need special handling.
+   //
+   static bool GetStackEffect(Code code, Word const *c, Word &pop, Word &push)
+   {
+      pop = push = 0;
+
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) \
+            case Code::name: pop = 2; push = 1; return true;
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedOpSet(name) \
+            case Code::name##_GblReg: \
+            case Code::name##_HubReg: \
+            case Code::name##_LocReg: \
+            case Code::name##_ModReg: pop = 1; return true; \
+            case Code::name##_GblArr: \
+            case Code::name##_HubArr: \
+            case Code::name##_LocArr: \
+            case Code::name##_ModArr: pop = 2; return true;
+         #include "CodeList.hpp"
+
+      case Code::DecU_GblArr:
+      case Code::DecU_HubArr:
+      case Code::DecU_LocArr:
+      case Code::DecU_ModArr:
+      case Code::IncU_GblArr:
+      case Code::IncU_HubArr:
+      case Code::IncU_LocArr:
+      case Code::IncU_ModArr:
+      case Code::Drop_Nul:
+      case Code::Drop_ScrRet:
+      case Code::ScrDelay:
+      case Code::ScrWaitI:
+      case Code::ScrWaitS:
+         pop = 1;
+         return true;
+
+      case Code::Push_StrArs:
+         pop = 2; push = 1;
+         return true;
+
+      case Code::Copy:
+      case Code::Pfun_Lit:
+      case Code::Push_GblReg:
+      case Code::Push_HubReg:
+      case Code::Push_Lit:
+      case Code::Push_LocReg:
+      case Code::Push_ModReg:
+         push = 1;
+         return true;
+
+      case Code::Push_LitArr:
+         push = c[1];
+         return true;
+
+      // Functions are assumed to push at most one result. Hosts that push more
+      // are covered by Thread::DataStkSize, which is reserved beyond the
+      // traced use.
+      case Code::CallFunc:
+      case Code::CallSpec_R1:
+         pop = c[1]; push = 1;
+         return true;
+
+      case Code::CallFunc_Lit:
+         push = 1;
+         return true;
+
+      case Code::CallSpec:
+         pop = c[1];
+         return true;
+
+      case Code::DecU_GblReg:
+      case Code::DecU_HubReg:
+      case Code::DecU_LocReg:
+      case Code::DecU_ModReg:
+      case Code::IncU_GblReg:
+      case Code::IncU_HubReg:
+      case Code::IncU_LocReg:
+      case Code::IncU_ModReg:
+      case Code::CallSpec_Lit:
+      case Code::InvU:
+      case Code::NegI:
+      case Code::NotU:
+      case Code::Nop:
+      case Code::Pstr_Stk:
+      case Code::Push_GblArr:
+      case Code::Push_HubArr:
+      case Code::Push_LocArr:
+      case Code::Push_ModArr:
+      case Code::ScrDelay_Lit:
+      case Code::ScrHalt:
+      case Code::ScrWaitI_Lit:
+      case Code::ScrWaitS_Lit:
+      case Code::Swap:
+         return true;
+
+      default:
+         return false;
+      }
+   }
+}
+
+
+//----------------------------------------------------------------------------|
+// Extern Functions                                                           |
+//
+
+namespace ACSVM
+{
+   //
+   // StackTracer constructor
+   //
+   StackTracer::StackTracer(Optimizer *opt_) :
+      opt   {opt_},
+      module{opt_->module},
+      calls (opt_->module->codeV.size())
+   {
+   }
+
+   //
+   // StackTracer::traceCode
+   //
+   // Follows every path from entry, tracking the depth of the data stack.
+   // Depths are relative to entry, as arguments are already in locals.
+   //
+   StackTracer::Info StackTracer::traceCode(Word entry, Script const *script)
+   {
+      std::size_t size = module->codeV.size();
+
+      Info info;
+      bool capped = false; // Depth exceeded the frame limit.
+      Word callee = 0;     // Largest data stack use of any callee.
+
+      std::unordered_map<Word, Word>     depths;
+      std::vector<std::pair<Word, Word>> work;
+      std::vector<Word>                  sites;
+
+      // Once capped, only continue far enough to find every call site.
+      auto branch = [&](Word idx, Word depth)
+      {
+         if(idx >= size) return;
+
+         auto itr = depths.find(idx);
+         if(itr == depths.end())
+            depths.emplace(idx, depth);
+         else if(!capped && depth > itr->second)
+            itr->second = depth;
+         else
+            return;
+
+         work.emplace_back(idx, depth);
+      };
+
+      auto drop = [](Word depth, Word n) {return depth > n ? depth - n : 0;};
+
+      branch(entry, 0);
+      while(!work.empty())
+      {
+         Word iter  = work.back().first;
+         Word depth = work.back().second;
+         work.pop_back();
+
+         // Skip paths superseded by a deeper one.
+         if(depths[iter] != depth)
+            continue;
+
+         // Stack growing without limit, most likely in a loop, or a code
+         // whose result is not used.
+         if(depth > Thread::DataStkSize)
+            capped = true;
+
+         Code        code = opt->getCode(iter);
+         Word const *c    = &module->codeV[iter];
+         Word        next = iter + opt->getCodeSize(iter);
+         Word        pop, push, peak;
+
+         switch(code)
+         {
+         case Code::Kill:
+         case Code::ScrTerm:
+            continue;
+
+         case Code::Retn:
+            info.retnC = std::max(info.retnC, depth);
+            continue;
+
+         case Code::ScrRestart:
+            if(script)
+               branch(script->codeIdx, depth);
+            else
+               info.bound = false;
+            continue;
+
+         case Code::Jump_Lit:
+            branch(c[1], depth);
+            continue;
+
+         case Code::Jump_Stk:
+            for(Jump &jump : module->jumpV)
+               branch(jump.codeIdx, drop(depth, 1));
+            continue;
+
+         case Code::Jcnd_Lit:
+            branch(c[2], drop(depth, 1));
+            peak = depth;
+            break;
+
+         case Code::Jcnd_Nil:
+         case Code::Jcnd_Tru:
+            branch(c[1], depth = drop(depth, 1));
+            peak = depth;
+            break;
+
+         case Code::Jcnd_Tab:
+            if(c[1] < module->jumpMapV.size())
+               for(auto &jump : module->jumpMapV[c[1]].table)
+                  branch(jump.val, drop(depth, 1));
+            peak = depth;
+            break;
+
+         case Code::Call_Lit:
+            sites.push_back(iter);
+            peak = depth;
+            if(Function *func = c[1] < module->functionV.size() ? module->functionV[c[1]] : nullptr)
+            {
+               if(func->module != module)
+                  info.bound = false;
+               else if(info.bound)
+               {
+                  Info const &call = traceFunc(func);
+                  if(!call.bound)
+                     info.bound = false;
+
+                  depth  = drop(depth, func->argC);
+                  peak   = depth + call.dataC;
+                  depth  = depth + call.retnC;
+                  callee = std::max(callee, call.dataC);
+
+                  info.callC = std::max(info.callC, call.callC + 1);
+               }
+            }
+            else
+               info.bound = false;
+            break;
+
+         default:
+            if(!GetStackEffect(code, c, pop, push))
+            {
+               info.bound = false;
+               continue;
+            }
+
+            depth = drop(depth, pop) + push;
+            peak  = depth;
+            break;
+         }
+
+         info.dataC = std::max({info.dataC, peak, depth});
+         branch(next, depth);
+      }
+
+      // Without a depth, callees can start anywhere in the frame.
+      if(capped)
+      {
+         info.dataC = Thread::DataStkSize + callee;
+         info.retnC = Thread::DataStkSize;
+      }
+
+      for(Word site : sites)
+         calls[site] |= info.bound ? 1 : 2;
+
+      return info;
+   }
+
+   //
+   // StackTracer::traceFunc
+   //
+   StackTracer::Info const &StackTracer::traceFunc(Function *func)
+   {
+      auto itr = funcs.find(func);
+      if(itr != funcs.end())
+      {
+         // Recursive call.
+         if(itr->second.busy)
+            itr->second.bound = false;
+
+         return itr->second;
+      }
+
+      funcs[func].busy = true;
+
+      Info info = traceCode(func->codeIdx, nullptr);
+
+      // Recursion found while tracing.
+      if(!funcs[func].bound)
+         info.bound = false;
+
+      func->callStkC = info.callC;
+      func->dataStkC = info.dataC;
+      func->flagStk  = info.bound;
+
+      return funcs[func] = info;
+   }
+
+   //
+   // Optimizer constructor
+   //
+   Optimizer::Optimizer(Environment *env_, Module *module_) :
+      env   {env_},
+      module{module_}
+   {
+   }
+
+   //
+   // Optimizer::encode
+   //
+   // Converts codes into the form dispatched on by Thread::exec. This must be
+   // the last pass, as codes are no longer readable afterwards. The layout of
+   // the code is unchanged, so code indexes remain valid for serialization.
+   //
+   void Optimizer::encode()
+   {
+      // Nothing to do if exec dispatches directly on codes.
+      if(Thread::ExecCode(Code::Kill) == static_cast<Word>(Code::Kill))
+         return;
+
+      // Every code must be converted, including the remainder of fused
+      // sequences, as they can still be branched to.
+      for(std::size_t iter = 0, end = module->codeV.size(), next; iter != end; iter = next)
+      {
+         Code code = getCode(iter);
+
+         if(!(next = GetFusedHeadSize(code)))
+            next = getCodeSize(iter);
+
+         next += iter;
+
+         module->codeV[iter] = Thread::ExecCode(code);
+      }
+   }
+
+   //
+   // Optimizer::fuse
+   //
+   // Replaces common code sequences with fused codes. Only the leading code
+   // is rewritten, so any branch into the sequence remains valid.
+   //
+   void Optimizer::fuse()
+   {
+      for(std::size_t iter = 0, end = module->codeV.size(); iter != end;)
+         iter += fuseCode(iter);
+   }
+
+   //
+   // Optimizer::fuseCode
+   //
+   // Attempts to fuse the sequence at iter, returning the size of the
+   // resulting code.
+   //
+   std::size_t Optimizer::fuseCode(std::size_t iter)
+   {
+      // Read the next several codes.
+      Code        codes[4];
+      std::size_t iters[5] = {iter};
+      for(std::size_t i = 0; i != 4; ++i)
+      {
+         if(iters[i] == module->codeV.size())
+         {
+            for(; i != 4; ++i) codes[i] = Code::None;
+            break;
+         }
+
+         codes[i]     = getCode(iters[i]);
+         iters[i + 1] = iters[i] + getCodeSize(iters[i]);
+      }
+
+      Code        fused  = Code::None;
+      std::size_t fusedC = 1;
+
+      switch(codes[0])
+      {
+      case Code::Push_Lit:
+         if((fused = GetFusedJcmp(codes[1], codes[2]).lit) != Code::None)
+            fusedC = 3;
+         else if((fused = GetFusedLit(codes[1])) != Code::None ||
+            (fused = GetFusedLocRegLit(codes[1])) != Code::None)
+            fusedC = 2;
+         break;
+
+      case Code::Push_LocReg:
+         if(codes[1] == Code::Push_Lit)
+         {
+            if((fused = GetFusedJcmp(codes[2], codes[3]).locLit) != Code::None)
+               fusedC = 4;
+            else if(codes[3] == Code::Drop_LocReg &&
+               (fused = GetFusedLocLitDrop(codes[2])) != Code::None)
+               fusedC = 4;
+            else if((fused = GetFusedLocLit(codes[2])) != Code::None)
+               fusedC = 3;
+         }
+         else if(codes[1] == Code::Push_LocReg)
+         {
+            if((fused = GetFusedJcmp(codes[2], codes[3]).locLoc) != Code::None)
+               fusedC = 4;
+            else if(codes[3] == Code::Drop_LocReg &&
+               (fused = GetFusedLocLocDrop(codes[2])) != Code::None)
+               fusedC = 4;
+            else if((fused = GetFusedLocLoc(codes[2])) != Code::None)
+               fusedC = 3;
+         }
+         else if((fused = GetFusedLocRegLoc(codes[1])) != Code::None)
+            fusedC = 2;
+         break;
+
+      default:
+         if((fused = GetFusedJcmp(codes[0], codes[1]).stk) != Code::None)
+            fusedC = 2;
+         break;
+      }
+
+      if(fused != Code::None)
+         module->codeV[iter] = static_cast<Word>(fused);
+
+      return iters[fusedC] - iter;
+   }
+
+   //
+   // Optimizer::getCode
+   //
+   Code Optimizer::getCode(std::size_t iter)
+   {
+      return static_cast<Code>(module->codeV[iter]);
+   }
+
+   //
+   // Optimizer::getCodeSize
+   //
+   // Returns the number of words used by the code at iter.
+   //
+   std::size_t Optimizer::getCodeSize(std::size_t iter)
+   {
+      switch(Code code = getCode(iter))
+      {
+      case Code::CallFunc_Lit:
+      case Code::CallSpec_Lit:
+         return 3 + module->codeV[iter + 1];
+
+      case Code::Push_LitArr:
+         return 2 + module->codeV[iter + 1];
+
+      default:
+         return 1 + env->getCodeData(code)->argc;
+      }
+   }
+
+   //
+   // Optimizer::native
+   //
+   // Hashes the translated code and looks up registered native code for it.
+   // If found, returns the code indexes where Thread::exec can enter the
+   // native code.
+   //
+   std::vector<std::size_t> Optimizer::native()
+   {
+      std::vector<std::size_t> entries;
+
+      module->codeHash = 2166136261u;
+      for(Word code : module->codeV)
+         module->codeHash = (module->codeHash ^ code) * 16777619u;
+
+      module->native = env->findNative(module->codeV.data(),
+         module->codeV.size(), module->codeHash);
+      if(!module->native)
+         return entries;
+
+      // Native code returns at any code it does not run, so it must be
+      // entered again at the code that follows.
+      bool enter = true;
+      for(std::size_t iter = 0, end = module->codeV.size(), next; iter != end; iter = next)
+      {
+         Code code = getCode(iter);
+
+         if(!(next = GetFusedHeadSize(code)))
+            next = getCodeSize(iter);
+
+         next += iter;
+
+         if(!IsNativeCode(code))
+            enter = true;
+         else if(enter)
+            entries.push_back(iter), enter = false;
+      }
+
+      // Also enter at every code that can be branched to by Thread::exec.
+      auto addEntry = [&](Word iter)
+      {
+         if(iter < module->codeV.size() && IsNativeCode(getCode(iter)))
+            entries.push_back(iter);
+      };
+
+      for(Function *func : module->functionV)
+         if(func && func->module == module) addEntry(func->codeIdx);
+
+      for(Jump &jump : module->jumpV)
+         addEntry(jump.codeIdx);
+
+      for(Script &scr : module->scriptV)
+         addEntry(scr.codeIdx);
+
+      return entries;
+   }
+
+   //
+   // Optimizer::peephole
+   //
+   // Rewrites the translated code to remove and simplify codes. Unlike the
+   // other passes, this changes the layout of the code, so it must be run
+   // first and every stored code index is remapped afterwards. Sequences are
+   // never rewritten across a branch target.
+   //
+   void Optimizer::peephole()
+   {
+      // Minimum number of consecutive Jcnd_Lit to convert to a Jcnd_Tab.
+      constexpr std::size_t LadderMin = 3;
+
+      std::size_t size = module->codeV.size();
+
+      // Follows chains of Jump_Lit to their final target.
+      auto follow = [&](Word idx)
+      {
+         for(int hops = 0; hops != 16 && idx < size && getCode(idx) == Code::Jump_Lit; ++hops)
+            idx = module->codeV[idx + 1];
+         return idx;
+      };
+
+      // Collect branch targets, shortening jumps along the way.
+      std::vector<bool> target(size + 1);
+      auto addTarget = [&](Word idx) {if(idx < size) target[idx] = true;};
+
+      for(std::size_t iter = 0; iter != size; iter += getCodeSize(iter))
+      {
+         if(std::size_t arg = GetJumpArg(getCode(iter)))
+         {
+            Word &idx = module->codeV[iter + arg];
+            addTarget(idx = follow(idx));
+         }
+      }
+
+      for(JumpMap &map : module->jumpMapV)
+         for(auto &jump : map.table)
+            addTarget(jump.val = follow(jump.val));
+
+      for(Function *func : module->functionV)
+         if(func && func->module == module) addTarget(func->codeIdx);
+
+      for(Jump &jump : module->jumpV)
+         addTarget(jump.codeIdx);
+
+      for(Script &scr : module->scriptV)
+         addTarget(scr.codeIdx);
+
+      // Rewrite code.
+      std::vector<Word>        codeV;
+      std::vector<Word>        index(size + 1); // New index of branch targets.
+      std::vector<std::size_t> jumps;           // New indexes of jump operands.
+      std::vector<std::size_t> ops;             // Codes since the last target.
+
+      std::vector<std::vector<std::pair<Word, Word>>> maps;
+
+      auto isLit = [&](std::size_t i)
+         {return static_cast<Code>(codeV[i]) == Code::Push_Lit;};
+
+      for(std::size_t iter = 0, next; iter != size; iter = next)
+      {
+         Code code = getCode(iter);
+         next = iter + getCodeSize(iter);
+
+         index[iter] = codeV.size();
+         if(target[iter])
+            ops.clear();
+
+         switch(code)
+         {
+         case Code::Nop:
+            continue;
+
+         case Code::Drop_Nul:
+            // Discard pushes of values that are immediately dropped.
+            if(!ops.empty()) switch(static_cast<Code>(codeV[ops.back()]))
+            {
+            case Code::Push_GblReg:
+            case Code::Push_HubReg:
+            case Code::Push_Lit:
+            case Code::Push_LocReg:
+            case Code::Push_ModReg:
+               codeV.resize(ops.back());
+               ops.pop_back();
+               continue;
+
+            default:
+               break;
+            }
+            break;
+
+         case Code::InvU:
+         case Code::NegI:
+         case Code::NotU:
+            if(!ops.empty() && isLit(ops.back()))
+            {
+               FoldUnary(code, codeV.back());
+               continue;
+            }
+            break;
+
+            #define ACSVM_CodeListFusedOp(name) case Code::name:
+            #include "CodeList.hpp"
+            if(ops.size() >= 2 && isLit(ops[ops.size() - 2]) && isLit(ops.back()))
+            {
+               Word lop = codeV[ops.back() - 1], rop = codeV.back();
+               if(!FoldOp(code, lop, rop))
+                  break;
+
+               codeV.resize(ops.back());
+               ops.pop_back();
+               codeV.back() = lop;
+               continue;
+            }
+            break;
+
+         case Code::Jcnd_Lit:
+            {
+               // Convert a ladder of Jcnd_Lit into a single table lookup.
+               std::size_t last = iter, count = 0;
+               while(last != size && getCode(last) == Code::Jcnd_Lit &&
+                  (last == iter || !target[last]))
+               {
+                  last += getCodeSize(last);
+                  ++count;
+               }
+
+               if(count < LadderMin)
+                  break;
+
+               // Only the first of any duplicate cases can be taken.
+               std::vector<std::pair<Word, Word>> map;
+               for(std::size_t i = iter; i != last; i += getCodeSize(i))
+               {
+                  Word key = module->codeV[i + 1];
+                  auto itr = map.begin();
+                  while(itr != map.end() && itr->first != key) ++itr;
+                  if(itr == map.end())
+                     map.emplace_back(key, module->codeV[i + 2]);
+               }
+
+               ops.push_back(codeV.size());
+               codeV.push_back(static_cast<Word>(Code::Jcnd_Tab));
+               codeV.push_back(module->jumpMapV.size() + maps.size());
+               maps.push_back(std::move(map));
+               next = last;
+            }
+            continue;
+
+         default:
+            break;
+         }
+
+         ops.push_back(codeV.size());
+         if(std::size_t arg = GetJumpArg(code))
+            jumps.push_back(codeV.size() + arg);
+         codeV.insert(codeV.end(), &module->codeV[iter], &module->codeV[next]);
+      }
+
+      index[size] = codeV.size();
+
+      // Remap code indexes.
+      auto remap = [&](Word &idx) {idx = idx < size ? index[idx] : 0;};
+
+      for(std::size_t i : jumps)
+         remap(codeV[i]);
+
+      if(!maps.empty())
+      {
+         Vector<JumpMap> jumpMapV{module->jumpMapV.size() + maps.size()};
+
+         std::vector<std::pair<Word, Word>> map;
+         for(std::size_t i = 0; i != module->jumpMapV.size(); ++i)
+         {
+            map.clear();
+            for(auto &jump : module->jumpMapV[i].table)
+               map.emplace_back(jump.key, jump.val);
+            jumpMapV[i].setJumps(map.data(), map.size());
+         }
+
+         for(std::size_t i = 0; i != maps.size(); ++i)
+            jumpMapV[module->jumpMapV.size() + i].setJumps(maps[i].data(), maps[i].size());
+
+         module->jumpMapV = std::move(jumpMapV);
+      }
+
+      for(JumpMap &map : module->jumpMapV)
+         for(auto &jump : map.table)
+            remap(jump.val);
+
+      for(Function *func : module->functionV)
+         if(func && func->module == module) remap(func->codeIdx);
+
+      for(Jump &jump : module->jumpV)
+         remap(jump.codeIdx);
+
+      for(Script &scr : module->scriptV)
+         remap(scr.codeIdx);
+
+      module->codeV = Vector<Word>(codeV.data(), codeV.size());
+   }
+
+   //
+   // Optimizer::optimize
+   //
+   // Runs all enabled passes on the module's translated code.
+   //
+   void Optimizer::optimize()
+   {
+      if(env->codePeephole)
+         peephole();
+
+      stack();
+
+      if(env->codeFuse)
+         fuse();
+
+      // Native entry points must be found while codes are still readable,
+      // but can only be marked once the other codes are encoded.
+      std::vector<std::size_t> entries = native();
+
+      // Keep the readable codes for code generation.
+      module->codeSrcV = Vector<Word>(module->codeV.data(), module->codeV.size());
+
+      encode();
+
+      for(std::size_t iter : entries)
+         module->codeV[iter] = Thread::ExecCode(Code::Native);
+
+      // Modules without native code may get it as they run.
+      module->jit = JitModule::Create(module);
+   }
+
+   //
+   // Optimizer::stack
+   //
+   // Finds the stack use of the module's functions and scripts. Calls made
+   // from code with bounded stack use are replaced with Call_Bnd, which does
+   // not reserve, as its stack use was reserved along with the caller's.
+   //
+   void Optimizer::stack()
+   {
+      StackTracer tracer{this};
+
+      for(Function *func : module->functionV)
+         if(func && func->module == module) tracer.traceFunc(func);
+
+      for(Script &scr : module->scriptV)
+      {
+         auto info = tracer.traceCode(scr.codeIdx, &scr);
+
+         scr.callStkC = info.callC;
+         scr.dataStkC = info.dataC;
+         scr.flagStk  = info.bound;
+      }
+
+      // Call sites reached by both bounded and unbounded code must reserve.
+      for(std::size_t iter = 0, end = tracer.calls.size(); iter != end; ++iter)
+      {
+         if(tracer.calls[iter] == 1)
+            module->codeV[iter] = static_cast<Word>(Code::Call_Bnd);
+      }
+   }
+
+   //
+   // Optimizer::GetFusedHeadSize
+   //
+   std::size_t Optimizer::GetFusedHeadSize(Code code)
+   {
+      switch(code)
+      {
+         #define ACSVM_CodeListFusedOp(name) \
+            case Code::name##_Lit: \
+            case Code::name##_LocLit: \
+            case Code::name##_LocLit_Drop: \
+            case Code::name##_LocLoc: \
+            case Code::name##_LocLoc_Drop: \
+               return 2;
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedOpSet(name) \
+            case Code::name##_LocReg_Lit: \
+            case Code::name##_LocReg_Loc: \
+               return 2;
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedJcmp(name, inv) \
+            case Code::Jcmp##name: \
+               return 1; \
+            case Code::Jcmp##name##_Lit: \
+            case Code::Jcmp##name##_LocLit: \
+            case Code::Jcmp##name##_LocLoc: \
+               return 2;
+         #include "CodeList.hpp"
+
+      default: return 0;
+      }
+   }
+}
+
+// EOF
+
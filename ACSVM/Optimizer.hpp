@@ -0,0 +1,67 @@
+//-----------------------------------------------------------------------------
+//
+// Copyright (C) 2015-2017 David Hill
+//
+// See COPYING for license information.
+//
+//-----------------------------------------------------------------------------
+//
+// Optimizer classes.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef ACSVM__Optimizer_H__
+#define ACSVM__Optimizer_H__
+
+#include "Types.hpp"
+
+#include <vector>
+
+
+//----------------------------------------------------------------------------|
+// Types                                                                      |
+//
+
+namespace ACSVM
+{
+   //
+   // Optimizer
+   //
+   // Rewrites translated code in place to reduce dispatch overhead.
+   //
+   class Optimizer
+   {
+   public:
+      Optimizer(Environment *env, Module *module);
+
+      void encode();
+
+      void fuse();
+
+      Code getCode(std::size_t iter);
+
+      std::size_t getCodeSize(std::size_t iter);
+
+      void optimize();
+
+      void peephole();
+
+      void stack();
+
+      Environment *env;
+      Module      *module;
+
+
+      // Returns the size of the code that a fused code replaced, or 0 if code
+      // is not a fused code.
+      static std::size_t GetFusedHeadSize(Code code);
+
+   private:
+      std::size_t fuseCode(std::size_t iter);
+
+      std::vector<std::size_t> native();
+   };
+}
+
+#endif//ACSVM__Optimizer_H__
+
@@ -24,6 +24,8 @@
 #include "Thread.hpp"
 
 #include <algorithm>
+#include <iterator>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -34,12 +36,30 @@
 
 namespace ACSVM
 {
+   //
+   // ThreadRun
+   //
+   // Entry in a MapScope's run table. Entries are left in place when their
+   // thread is freed elsewhere, and skipped when reached. See RunValid.
+   //
+   struct ThreadRun
+   {
+      Thread *thread;
+      DWord   seq;
+      Word    prio; // Script priority when the entry was made.
+   };
+
    //
    // GlobalScope::PrivData
    //
    struct GlobalScope::PrivData
    {
       HashMapKeyMem<Word, HubScope, &HubScope::id, &HubScope::hashLink> scopes;
+
+      // HubScopes left to execute in the current tic, for execUntil.
+      std::vector<Word> execIDs;
+      std::size_t       execIdx  = 0;
+      bool              execPend = false; // Tic is unfinished.
    };
 
    //
@@ -48,6 +68,11 @@ namespace ACSVM
    struct HubScope::PrivData
    {
       HashMapKeyMem<Word, MapScope, &MapScope::id, &MapScope::hashLink> scopes;
+
+      // MapScopes left to execute in the current tic, for execUntil.
+      std::vector<Word> execIDs;
+      std::size_t       execIdx  = 0;
+      bool              execPend = false; // Tic is unfinished.
    };
 
    //
@@ -55,16 +80,98 @@ namespace ACSVM
    //
    struct MapScope::PrivData
    {
+      PrivData() : execIdx{0}, execLast{}, execSeq{0}, execTic{0}, execPend{false} {}
+
       HashMapFixed<Module *, ModuleScope> scopes;
 
       HashMapFixed<Word,     Script *> scriptInt;
       HashMapFixed<String *, Script *> scriptStr;
 
       HashMapFixed<Script *, Thread *> scriptThread;
+
+      // Threads waiting on a script, woken when it stops being active.
+      HashMapFixed<Script *, ListLink<Thread>> scriptWait;
+
+      // Threads waiting on a tag, keyed by TagKey. Only used if tagNotify.
+      std::unordered_map<DWord, ListLink<Thread>> tagWait;
+
+      // Threads that are not waiting, in execution order. During a tic, the
+      // threads kept for the next are moved to threadNext.
+      std::vector<ThreadRun> threadRun;
+      std::vector<ThreadRun> threadNext;
+
+      // Threads to merge into the run table when the next tic begins.
+      std::vector<ThreadRun> threadLate;
+
+      // Threads woken or started during a tic, as a heap ordered by
+      // execution order.
+      std::vector<ThreadRun> threadWake;
+
+      // Threads waiting on a delay, indexed by the tic they wake on. Threads
+      // with longer delays are passed over until their tic comes around.
+      ListLink<Thread> threadWait[256];
+
+      // Threads kept by scriptStartResult for reuse. Only this scope uses
+      // them, so taking one does not lock the Environment.
+      ListLink<Thread> threadSync;
+
+      std::size_t execIdx;  // Next entry in threadRun, if execPend.
+      ThreadRun   execLast; // Last entry executed in the tic, if any.
+      DWord       execSeq;  // Next thread execution order.
+      Word        execTic;  // Current tic.
+      bool        execPend; // Tic is unfinished.
    };
 }
 
 
+//----------------------------------------------------------------------------|
+// Static Functions                                                           |
+//
+
+namespace ACSVM
+{
+   //
+   // RunAfter
+   //
+   // Orders threadWake so that its front is the earliest thread.
+   //
+   static bool RunAfter(ThreadRun const &l, ThreadRun const &r)
+   {
+      return l.prio != r.prio ? l.prio < r.prio : l.seq > r.seq;
+   }
+
+   //
+   // RunBefore
+   //
+   // Threads execute in order of priority, then in the order they started.
+   //
+   static bool RunBefore(ThreadRun const &l, ThreadRun const &r)
+   {
+      return l.prio != r.prio ? l.prio > r.prio : l.seq < r.seq;
+   }
+
+   //
+   // RunValid
+   //
+   // Checks that a run table entry's thread has not left the table. Freed
+   // threads may already have been started again, possibly in another scope.
+   //
+   static bool RunValid(MapScope const *map, ThreadRun const &run)
+   {
+      return run.thread->execRun && run.thread->execSeq == run.seq &&
+         run.thread->scopeMap == map;
+   }
+
+   //
+   // TagKey
+   //
+   static DWord TagKey(Word type, Word tag)
+   {
+      return static_cast<DWord>(type) << 32 | tag;
+   }
+}
+
+
 //----------------------------------------------------------------------------|
 // Extern Objects                                                             |
 //
@@ -130,21 +237,55 @@ namespace ACSVM
    //
    void GlobalScope::exec()
    {
-      // Delegate deferred script actions.
-      for(auto itr = scriptAction.begin(), end = scriptAction.end(); itr != end;)
+      execUntil(std::chrono::steady_clock::time_point::max());
+   }
+
+   //
+   // GlobalScope::execUntil
+   //
+   bool GlobalScope::execUntil(std::chrono::steady_clock::time_point end)
+   {
+      bool ran = false;
+      return execUntil(end, ran);
+   }
+
+   //
+   // GlobalScope::execUntil
+   //
+   bool GlobalScope::execUntil(std::chrono::steady_clock::time_point end, bool &ran)
+   {
+      if(!pd->execPend)
       {
-         auto scope = pd->scopes.find(itr->id.global);
-         if(scope && scope->active)
-            itr++->link.relink(&scope->scriptAction);
-         else
-            ++itr;
+         // Delegate deferred script actions.
+         for(auto itr = scriptAction.begin(), last = scriptAction.end(); itr != last;)
+         {
+            auto scope = pd->scopes.find(itr->id.global);
+            if(scope && scope->active)
+               itr++->link.relink(&scope->scriptAction);
+            else
+               ++itr;
+         }
+
+         pd->execIDs.clear();
+         for(auto &scope : pd->scopes)
+         {
+            if(scope.active)
+               pd->execIDs.push_back(scope.id);
+         }
+
+         pd->execIdx  = 0;
+         pd->execPend = true;
       }
 
-      for(auto &scope : pd->scopes)
+      for(; pd->execIdx != pd->execIDs.size(); ++pd->execIdx)
       {
-         if(scope.active)
-            scope.exec();
+         auto scope = pd->scopes.find(pd->execIDs[pd->execIdx]);
+         if(scope && scope->active && !scope->execUntil(end, ran))
+            return false;
       }
+
+      pd->execPend = false;
+      return true;
    }
 
    //
@@ -223,6 +364,15 @@ namespace ACSVM
          scope.lockStrings();
    }
 
+   //
+   // GlobalScope::notifyTag
+   //
+   void GlobalScope::notifyTag(Word type, Word tag)
+   {
+      for(auto &scope : pd->scopes)
+         scope.notifyTag(type, tag);
+   }
+
    //
    // GlobalScope::refStrings
    //
@@ -247,6 +397,8 @@ namespace ACSVM
          delete scriptAction.next->obj;
 
       pd->scopes.free();
+
+      pd->execPend = false;
    }
 
    //
@@ -340,21 +492,55 @@ namespace ACSVM
    //
    void HubScope::exec()
    {
-      // Delegate deferred script actions.
-      for(auto itr = scriptAction.begin(), end = scriptAction.end(); itr != end;)
+      execUntil(std::chrono::steady_clock::time_point::max());
+   }
+
+   //
+   // HubScope::execUntil
+   //
+   bool HubScope::execUntil(std::chrono::steady_clock::time_point end)
+   {
+      bool ran = false;
+      return execUntil(end, ran);
+   }
+
+   //
+   // HubScope::execUntil
+   //
+   bool HubScope::execUntil(std::chrono::steady_clock::time_point end, bool &ran)
+   {
+      if(!pd->execPend)
       {
-         auto scope = pd->scopes.find(itr->id.global);
-         if(scope && scope->active)
-            itr++->link.relink(&scope->scriptAction);
-         else
-            ++itr;
+         // Delegate deferred script actions.
+         for(auto itr = scriptAction.begin(), last = scriptAction.end(); itr != last;)
+         {
+            auto scope = pd->scopes.find(itr->id.global);
+            if(scope && scope->active)
+               itr++->link.relink(&scope->scriptAction);
+            else
+               ++itr;
+         }
+
+         pd->execIDs.clear();
+         for(auto &scope : pd->scopes)
+         {
+            if(scope.active)
+               pd->execIDs.push_back(scope.id);
+         }
+
+         pd->execIdx  = 0;
+         pd->execPend = true;
       }
 
-      for(auto &scope : pd->scopes)
+      for(; pd->execIdx != pd->execIDs.size(); ++pd->execIdx)
       {
-         if(scope.active)
-            scope.exec();
+         auto scope = pd->scopes.find(pd->execIDs[pd->execIdx]);
+         if(scope && scope->active && !scope->execUntil(end, ran))
+            return false;
       }
+
+      pd->execPend = false;
+      return true;
    }
 
    //
@@ -433,6 +619,15 @@ namespace ACSVM
          scope.lockStrings();
    }
 
+   //
+   // HubScope::notifyTag
+   //
+   void HubScope::notifyTag(Word type, Word tag)
+   {
+      for(auto &scope : pd->scopes)
+         scope.notifyTag(type, tag);
+   }
+
    //
    // HubScope::refStrings
    //
@@ -457,6 +652,8 @@ namespace ACSVM
          delete scriptAction.next->obj;
 
       pd->scopes.free();
+
+      pd->execPend = false;
    }
 
    //
@@ -580,11 +777,13 @@ namespace ACSVM
       pd->scriptInt.alloc(scriptIntC);
       pd->scriptStr.alloc(scriptStrC);
       pd->scriptThread.alloc(scriptThrC);
+      pd->scriptWait.alloc(scriptThrC);
 
       auto scopeItr     = pd->scopes.begin();
       auto scriptIntItr = pd->scriptInt.begin();
       auto scriptStrItr = pd->scriptStr.begin();
       auto scriptThrItr = pd->scriptThread.begin();
+      auto scriptWaitItr = pd->scriptWait.begin();
 
       for(auto &module : modules.vec)
       {
@@ -596,9 +795,11 @@ namespace ACSVM
          {
             using ElemInt = HashMapFixed<Word,     Script *>::Elem;
             using ElemStr = HashMapFixed<String *, Script *>::Elem;
-            using ElemThr = HashMapFixed<Script *, Thread *>::Elem;
+            using ElemThr  = HashMapFixed<Script *, Thread *>::Elem;
+            using ElemWait = HashMapFixed<Script *, ListLink<Thread>>::Elem;
 
-            new(scriptThrItr++) ElemThr{&script, nullptr, nullptr};
+            new(scriptThrItr++)  ElemThr{&script, nullptr, nullptr};
+            new(scriptWaitItr++) ElemWait{&script, {}, nullptr};
 
             if(script.name.s)
                new(scriptStrItr++) ElemStr{script.name.s, &script, nullptr};
@@ -611,11 +812,52 @@ namespace ACSVM
       pd->scriptInt.build();
       pd->scriptStr.build();
       pd->scriptThread.build();
+      pd->scriptWait.build();
 
       for(auto &scope : pd->scopes)
          scope.val.import();
    }
 
+   //
+   // MapScope::blockThread
+   //
+   // Moves a thread waiting on an active script or, if tagNotify, a tag into
+   // the matching wait list.
+   //
+   void MapScope::blockThread(Thread *thread)
+   {
+      ListLink<Thread> *list;
+      Script           *script;
+
+      switch(thread->state.state)
+      {
+      case ThreadState::WaitScrI:
+         script = findScript(thread->state.data);
+         goto wait_script;
+
+      case ThreadState::WaitScrS:
+         script = findScript(getString(thread->state.data));
+      wait_script:
+         if(!isScriptActive(script))
+            return;
+         list = pd->scriptWait.find(script);
+         break;
+
+      case ThreadState::WaitTag:
+         if(!env->tagNotify)
+            return;
+         list = &pd->tagWait[TagKey(thread->state.type, thread->state.data)];
+         break;
+
+      default:
+         return;
+      }
+
+      thread->execBlock = true;
+      thread->execRun   = false;
+      thread->linkExec.relink(list);
+   }
+
    //
    // MapScope::countActiveThread
    //
@@ -629,43 +871,141 @@ namespace ACSVM
    //
    void MapScope::exec()
    {
-      // Execute deferred script actions.
-      while(scriptAction.next->obj)
-      {
-         ScriptAction *action = scriptAction.next->obj;
-         Script       *script = findScript(action->name);
+      execUntil(std::chrono::steady_clock::time_point::max());
+   }
 
-         if(script) switch(action->action)
+   //
+   // MapScope::execUntil
+   //
+   bool MapScope::execUntil(std::chrono::steady_clock::time_point end)
+   {
+      bool ran = false;
+      return execUntil(end, ran);
+   }
+
+   //
+   // MapScope::execUntil
+   //
+   bool MapScope::execUntil(std::chrono::steady_clock::time_point end, bool &ran)
+   {
+      bool timed = end != std::chrono::steady_clock::time_point::max();
+
+      auto &run  = pd->threadRun;
+      auto &next = pd->threadNext;
+      auto &late = pd->threadLate;
+      auto &wake = pd->threadWake;
+
+      if(!pd->execPend)
+      {
+         // Execute deferred script actions.
+         while(scriptAction.next->obj)
          {
-         case ScriptAction::Start:
-            scriptStart(script, {action->argV.data(), action->argV.size()});
-            break;
+            ScriptAction *action = scriptAction.next->obj;
+            Script       *script = findScript(action->name);
 
-         case ScriptAction::StartForced:
-            scriptStartForced(script, {action->argV.data(), action->argV.size()});
-            break;
+            if(script) switch(action->action)
+            {
+            case ScriptAction::Start:
+               scriptStart(script, {action->argV.data(), action->argV.size()});
+               break;
 
-         case ScriptAction::Stop:
-            scriptStop(script);
-            break;
+            case ScriptAction::StartForced:
+               scriptStartForced(script, {action->argV.data(), action->argV.size()});
+               break;
 
-         case ScriptAction::Pause:
-            scriptPause(script);
-            break;
+            case ScriptAction::Stop:
+               scriptStop(script);
+               break;
+
+            case ScriptAction::Pause:
+               scriptPause(script);
+               break;
+            }
+
+            delete action;
          }
 
-         delete action;
+         ++pd->execTic;
+         wakeThreads();
+         mergeThreads();
+
+         next.clear();
+         pd->execIdx  = 0;
+         pd->execLast = {};
+         pd->execPend = true;
       }
 
-      // Execute running threads.
-      for(auto itr = threadActive.begin(), end = threadActive.end(); itr != end;)
+      // Execute running threads in order, taking each from the run table or
+      // from those woken since. Threads that are delayed afterwards wait in
+      // the timer wheel, and threads waiting on a script or tag wait in a
+      // list, instead of being executed every tic.
+      for(;;)
       {
-         itr->exec();
-         if(itr->state == ThreadState::Inactive)
-            freeThread(&*itr++);
+         // Threads woken behind the last one executed wait for the next tic.
+         while(!wake.empty() && pd->execLast.thread &&
+            !RunBefore(pd->execLast, wake.front()))
+         {
+            std::pop_heap(wake.begin(), wake.end(), RunAfter);
+            late.push_back(wake.back());
+            wake.pop_back();
+         }
+
+         ThreadRun entry;
+
+         if(!wake.empty() && (pd->execIdx == run.size() ||
+            RunBefore(wake.front(), run[pd->execIdx])))
+         {
+            entry = wake.front();
+            std::pop_heap(wake.begin(), wake.end(), RunAfter);
+            wake.pop_back();
+         }
+         else if(pd->execIdx != run.size())
+            entry = run[pd->execIdx++];
          else
-            ++itr;
+            break;
+
+         if(!RunValid(this, entry))
+            continue;
+
+         Thread *thread = entry.thread;
+
+         // A thread that used up execBudget runs again while there is time
+         // left. Otherwise, it resumes on the next tic. The time is only
+         // checked once a thread has run, so that the call makes progress
+         // even if starting the tic used up its time.
+         for(;;)
+         {
+            if(timed && ran && std::chrono::steady_clock::now() >= end)
+            {
+               wake.push_back(entry);
+               std::push_heap(wake.begin(), wake.end(), RunAfter);
+               return false;
+            }
+
+            thread->exec();
+            ran = true;
+
+            if(!timed || !thread->execYield)
+               break;
+         }
+
+         pd->execLast = entry;
+
+         if(thread->state == ThreadState::Inactive)
+            freeThread(thread);
+         else if(thread->delay)
+            waitThread(thread);
+         else
+            blockThread(thread);
+
+         if(thread->execRun)
+            next.push_back(entry);
       }
+
+      run.swap(next);
+
+      pd->execPend = false;
+      return true;
    }
 
    //
@@ -705,7 +1045,10 @@ namespace ACSVM
    {
       auto itr = pd->scriptThread.find(thread->script);
       if(itr  && *itr == thread)
+      {
          *itr = nullptr;
+         wakeThreads(*pd->scriptWait.find(thread->script));
+      }
 
       env->freeThread(thread);
    }
@@ -732,6 +1075,14 @@ namespace ACSVM
       return module0->stringV[idx];
    }
 
+   //
+   // MapScope::getThreadDelay
+   //
+   Word MapScope::getThreadDelay(Thread const *thread) const
+   {
+      return thread->execWake - pd->execTic;
+   }
+
    //
    // MapScope::hasActiveThread
    //
@@ -808,6 +1159,7 @@ namespace ACSVM
          Thread *thread = env->getFreeThread();
          thread->link.insert(&threadActive);
          thread->loadState(in);
+         runThread(thread);
 
          if(in.in->get())
          {
@@ -833,6 +1185,67 @@ namespace ACSVM
          thread.lockStrings();
    }
 
+   //
+   // MapScope::mergeThreads
+   //
+   // Merges the threads in threadLate into the run table.
+   //
+   void MapScope::mergeThreads()
+   {
+      auto &late = pd->threadLate;
+      auto &next = pd->threadNext;
+      auto &run  = pd->threadRun;
+
+      if(late.empty())
+         return;
+
+      // Usually already in order, from the timer wheel.
+      if(!std::is_sorted(late.begin(), late.end(), RunBefore))
+         std::sort(late.begin(), late.end(), RunBefore);
+
+      next.clear();
+      next.reserve(run.size() + late.size());
+      std::merge(run.begin(), run.end(), late.begin(), late.end(),
+         std::back_inserter(next), RunBefore);
+
+      run.swap(next);
+      late.clear();
+   }
+
+   //
+   // MapScope::notifyTag
+   //
+   void MapScope::notifyTag(Word type, Word tag)
+   {
+      auto itr = pd->tagWait.find(TagKey(type, tag));
+      if(itr == pd->tagWait.end())
+         return;
+
+      wakeThreads(itr->second);
+      pd->tagWait.erase(itr);
+   }
+
+   //
+   // MapScope::queueThread
+   //
+   // Adds a thread to the run table. During a tic, it is added to threadWake
+   // so that it can still run this tic. Otherwise, it is merged in when the
+   // next tic begins.
+   //
+   void MapScope::queueThread(Thread *thread)
+   {
+      thread->execRun = true;
+      thread->linkExec.unlink();
+
+      if(pd->execPend)
+      {
+         pd->threadWake.push_back({thread, thread->execSeq, thread->script->priority});
+         std::push_heap(pd->threadWake.begin(), pd->threadWake.end(), RunAfter);
+      }
+      else
+         pd->threadLate.push_back({thread, thread->execSeq, thread->script->priority});
+   }
+
    //
    // MapScope::refStrings
    //
@@ -870,6 +1283,36 @@ namespace ACSVM
       pd->scriptInt.free();
       pd->scriptStr.free();
       pd->scriptThread.free();
+      pd->scriptWait.free();
+
+      pd->tagWait.clear();
+
+      while(pd->threadSync.next->obj)
+         env->freeThread(pd->threadSync.next->obj);
+
+      pd->threadRun.clear();
+      pd->threadNext.clear();
+      pd->threadLate.clear();
+      pd->threadWake.clear();
+
+      pd->execPend = false;
+   }
+
+   //
+   // MapScope::runThread
+   //
+   void MapScope::runThread(Thread *thread)
+   {
+      thread->execWait  = false;
+      thread->execBlock = false;
+
+      // Threads started by scriptStartResult are only queued if they do not
+      // finish on their first exec.
+      if(thread->execSync)
+         return;
+
+      thread->execSeq = pd->execSeq++;
+      queueThread(thread);
    }
 
    //
@@ -933,7 +1376,7 @@ namespace ACSVM
          return false;
 
       default:
-         (*itr)->state = ThreadState::Paused;
+         (*itr)->setState(ThreadState::Paused);
          return true;
       }
    }
@@ -969,7 +1412,7 @@ namespace ACSVM
          switch(thread->state.state)
          {
          case ThreadState::Paused:
-            thread->state = ThreadState::Running;
+            thread->setState(ThreadState::Running);
             return true;
 
          default:
@@ -1036,18 +1479,29 @@ namespace ACSVM
    //
    // MapScope::scriptStartResult
    //
+   // The thread is not added to the run table or scriptThread unless it is
+   // still running after its first exec, and is then kept for the next call.
+   //
    Word MapScope::scriptStartResult(Script *script, ScriptStartInfo const &info)
    {
-      Thread *thread = env->getFreeThread();
+      Thread *thread = pd->threadSync.next->obj;
+      if(thread)
+         thread->link.unlink();
+      else
+         thread = env->getFreeThread();
 
+      thread->execSync = true;
       thread->start(script, this, info.info, info.argV, info.argC);
+      thread->execSync = false;
       if(info.func) info.func(thread);
       if(info.funcc) info.funcc(thread);
       thread->exec();
 
       Word result = thread->result;
       if(thread->state == ThreadState::Inactive)
-         freeThread(thread);
+         thread->link.relink(&pd->threadSync);
+      else
+         runThread(thread);
       return result;
    }
 
@@ -1110,8 +1564,9 @@ namespace ACSVM
          return false;
 
       default:
-         (*itr)->state = ThreadState::Stopped;
-         (*itr)        = nullptr;
+         (*itr)->setState(ThreadState::Stopped);
+         (*itr) = nullptr;
+         wakeThreads(*pd->scriptWait.find(script));
          return true;
       }
    }
@@ -1148,6 +1603,64 @@ namespace ACSVM
          thread.unlockStrings();
    }
 
+   //
+   // MapScope::waitThread
+   //
+   void MapScope::waitThread(Thread *thread)
+   {
+      thread->execWake = pd->execTic + thread->delay;
+      thread->execWait = true;
+      thread->execRun  = false;
+      thread->linkExec.relink(&pd->threadWait[thread->execWake % 256]);
+   }
+
+   //
+   // MapScope::wakeThread
+   //
+   void MapScope::wakeThread(Thread *thread)
+   {
+      thread->delay = 0;
+
+      if(thread->execRun)
+         return;
+
+      thread->execWait  = false;
+      thread->execBlock = false;
+
+      // Keeps its execution order, so it may not run until the next tic.
+      queueThread(thread);
+   }
+
+   //
+   // MapScope::wakeThreads
+   //
+   // Returns threads whose delay ends this tic to the run table.
+   //
+   void MapScope::wakeThreads()
+   {
+      auto &wait = pd->threadWait[pd->execTic % 256];
+
+      for(ListLink<Thread> *link = wait.next; link->obj;)
+      {
+         Thread *thread = link->obj;
+         link = link->next;
+
+         if(thread->execWake == pd->execTic)
+            wakeThread(thread);
+      }
+   }
+
+   //
+   // MapScope::wakeThreads
+   //
+   // Returns all threads in a wait list to the run table.
+   //
+   void MapScope::wakeThreads(ListLink<Thread> &list)
+   {
+      while(list.next->obj)
+         wakeThread(list.next->obj);
+   }
+
    //
    // ModuleScope constructor
    //
@@ -1167,8 +1680,13 @@ namespace ACSVM
 
       for(std::size_t i = 0; i != ArrC; ++i)
       {
+         // Initialized arrays share their contents, so reserving only
+         // applies to the rest.
          if(i < module->arrInitV.size())
-            module->arrInitV[i].apply(selfArrV[i], module);
+            module->arrInitV[i].apply(selfArrV[i]);
+
+         if(i < module->arrSizeV.size())
+            selfArrV[i].reserve(module->arrSizeV[i]);
       }
 
       for(std::size_t i = 0; i != RegC; ++i)
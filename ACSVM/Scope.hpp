@@ -16,6 +16,8 @@
 #include "Array.hpp"
 #include "List.hpp"
 
+#include <chrono>
+
 
 //----------------------------------------------------------------------------|
 // Types                                                                      |
@@ -43,6 +45,14 @@ namespace ACSVM
 
       void exec();
 
+      // Executes until the current tic is finished or end is reached. See
+      // Environment::execFor.
+      bool execUntil(std::chrono::steady_clock::time_point end);
+
+      // As above, but end is only checked once ran is set, which is done
+      // after executing a thread.
+      bool execUntil(std::chrono::steady_clock::time_point end, bool &ran);
+
       void freeHubScope(HubScope *scope);
 
       HubScope *getHubScope(Word id);
@@ -53,6 +63,8 @@ namespace ACSVM
 
       void loadState(Serial &in);
 
+      void notifyTag(Word type, Word tag);
+
       void refStrings() const;
 
       void reset();
@@ -96,6 +108,14 @@ namespace ACSVM
 
       void exec();
 
+      // Executes until the current tic is finished or end is reached. See
+      // Environment::execFor.
+      bool execUntil(std::chrono::steady_clock::time_point end);
+
+      // As above, but end is only checked once ran is set, which is done
+      // after executing a thread.
+      bool execUntil(std::chrono::steady_clock::time_point end, bool &ran);
+
       void freeMapScope(MapScope *scope);
 
       MapScope *getMapScope(Word id);
@@ -106,6 +126,8 @@ namespace ACSVM
 
       void loadState(Serial &in);
 
+      void notifyTag(Word type, Word tag);
+
       void refStrings() const;
 
       void reset();
@@ -174,6 +196,14 @@ namespace ACSVM
 
       void exec();
 
+      // Executes until the current tic is finished or end is reached. See
+      // Environment::execFor.
+      bool execUntil(std::chrono::steady_clock::time_point end);
+
+      // As above, but end is only checked once ran is set, which is done
+      // after executing a thread.
+      bool execUntil(std::chrono::steady_clock::time_point end, bool &ran);
+
       Script *findScript(ScriptName name);
       Script *findScript(String *name);
       Script *findScript(Word name);
@@ -182,6 +212,9 @@ namespace ACSVM
 
       String *getString(Word idx) const;
 
+      // Returns the remaining delay of a thread waiting in the timer wheel.
+      Word getThreadDelay(Thread const *thread) const;
+
       bool hasActiveThread() const;
 
       bool hasModules() const;
@@ -192,10 +225,16 @@ namespace ACSVM
 
       void lockStrings() const;
 
+      // Wakes threads waiting on the given tag, if Environment::tagNotify.
+      void notifyTag(Word type, Word tag);
+
       void refStrings() const;
 
       void reset();
 
+      // Adds a thread to the end of the run table.
+      void runThread(Thread *thread);
+
       void saveState(Serial &out) const;
 
       bool scriptPause(Script *script);
@@ -213,6 +252,10 @@ namespace ACSVM
 
       void unlockStrings() const;
 
+      // Returns a thread waiting in the timer wheel or a wait list to the run
+      // table.
+      void wakeThread(Thread *thread);
+
       Environment *const env;
       HubScope    *const hub;
       Word         const id;
@@ -233,12 +276,21 @@ namespace ACSVM
    private:
       struct PrivData;
 
+      void blockThread(Thread *thread);
+
       void loadModules(Serial &in);
       void loadThreads(Serial &in);
+      void mergeThreads();
+      void queueThread(Thread *thread);
+
 
       void saveModules(Serial &out) const;
       void saveThreads(Serial &out) const;
 
+      void waitThread(Thread *thread);
+      void wakeThreads();
+      void wakeThreads(ListLink<Thread> &list);
+
       PrivData *pd;
    };
 
@@ -30,15 +30,20 @@ namespace ACSVM
 
       name{},
 
-      argC   {0},
-      codeIdx{0},
-      flags  {0},
-      locArrC{0},
-      locRegC{module->env->scriptLocRegC},
-      type   {0},
+      argC    {0},
+      codeIdx {0},
+      flags   {0},
+      locArrC {0},
+      locRegC {module->env->scriptLocRegC},
+      priority{0},
+      type    {0},
+
+      callStkC{0},
+      dataStkC{0},
 
       flagClient{false},
-      flagNet   {false}
+      flagNet   {false},
+      flagStk   {false}
    {
    }
 
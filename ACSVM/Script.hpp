@@ -14,6 +14,7 @@
 #define ACSVM__Script_H__
 
 #include "Types.hpp"
+#include "Vector.hpp"
 
 
 //----------------------------------------------------------------------------|
@@ -55,10 +56,20 @@ namespace ACSVM
       Word flags;
       Word locArrC;
       Word locRegC;
+      Word priority; // Threads with higher priority execute first each tic.
       Word type;
 
+      // Declared size of each local array, if known.
+      Vector<Word> locArrSizeV;
+
+      // Call frames and data stack words used by the script and everything
+      // it calls. Only valid if flagStk is set.
+      Word callStkC;
+      Word dataStkC;
+
       bool flagClient : 1;
       bool flagNet    : 1;
+      bool flagStk    : 1; // Stack use is statically bounded.
    };
 }
 
@@ -96,6 +96,15 @@ namespace ACSVM
          stkEnd = stack + idxEnd;
       }
 
+      //
+      // setEnd
+      //
+      // Moves the top of the stack without constructing or destructing any
+      // elements. Only meaningful for trivial types, where it is used to write
+      // back a stack pointer that was cached externally.
+      //
+      void setEnd(T *end) {stkPtr = end;}
+
       // size
       std::size_t size() const {return stkPtr - stack;}
 
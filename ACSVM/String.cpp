@@ -15,6 +15,8 @@
 #include "BinaryIO.hpp"
 #include "HashMap.hpp"
 
+#include <algorithm>
+#include <mutex>
 #include <new>
 #include <vector>
 
@@ -30,10 +32,61 @@ namespace ACSVM
    //
    struct StringTable::PrivData
    {
-      std::vector<Word> freeIdx;
+      static constexpr std::size_t ShardC = 16;
 
-      HashMapKeyObj<StringData, String, &String::link> stringByData{64, 64};
-      std::vector<String *>                            stringByIdx;
+      //
+      // Shard
+      //
+      struct Shard
+      {
+         std::mutex mutex;
+
+         HashMapKeyObj<StringData, String, &String::link> stringByData{16, 16};
+      };
+
+
+      // Selects a shard using the high bits of a multiplicative hash, as the
+      // low bits are used within the shard.
+      Shard &getShard(std::size_t hash)
+         {return shardV[(static_cast<std::uint32_t>(hash * 2654435761u) >> 28) % ShardC];}
+
+      //
+      // takeFreeIdx
+      //
+      // Takes an index freed by collection, returning false if there are
+      // none. Indexes are only freed while no strings are being added, so
+      // freeC can be checked without the lock.
+      //
+      bool takeFreeIdx(std::size_t &idx)
+      {
+         if(!freeC.load(std::memory_order_relaxed)) return false;
+
+         std::lock_guard<std::mutex> lock{mutexFree};
+
+         if(freeIdx.empty()) return false;
+
+         idx = freeIdx.back();
+         freeIdx.pop_back();
+         freeC.store(freeIdx.size(), std::memory_order_relaxed);
+         return true;
+      }
+
+      Shard shardV[ShardC];
+
+      // Free indexes shared by all shards, so that any index can be reused
+      // before the table grows.
+      std::mutex               mutexFree;
+      std::vector<Word>        freeIdx;
+      std::atomic<std::size_t> freeC{0};
+
+      // Guards adding pages.
+      std::mutex mutexPage;
+
+      std::vector<std::unique_ptr<String *[]>>  pageV;
+      std::vector<std::unique_ptr<String **[]>> pageListV; // Current last.
+
+      // Number of indexes ever used.
+      std::atomic<std::size_t> idxC{0};
    };
 }
 
@@ -124,8 +177,8 @@ namespace ACSVM
    // StringTable move constructor
    //
    StringTable::StringTable(StringTable &&table) :
-      strV{table.strV},
-      strC{table.strC},
+      strV{table.strV.load()},
+      strC{table.strC.load()},
 
       strNone{table.strNone},
 
@@ -158,33 +211,32 @@ namespace ACSVM
    //
    String &StringTable::operator [] (StringData const &data)
    {
-      if(auto str = pd->stringByData.find(data)) return *str;
+      auto &shard = pd->getShard(data.hash);
+
+      std::lock_guard<std::mutex> lock{shard.mutex};
 
-      Word idx;
-      if(pd->freeIdx.empty())
+      if(auto str = shard.stringByData.find(data)) return *str;
+
+      std::size_t idx;
+      if(!pd->takeFreeIdx(idx))
       {
+         idx = pd->idxC++;
+
          // Index has to fit within Word size.
          // If size_t has an equal or lesser max, then the check is redundant,
          // and some compilers warn about that kind of tautological comparison.
          #if SIZE_MAX > UINT32_MAX
-         if(pd->stringByIdx.size() > UINT32_MAX)
+         if(idx > UINT32_MAX)
             throw std::bad_alloc();
          #endif
 
-         idx = pd->stringByIdx.size();
-         pd->stringByIdx.emplace_back(strNone);
-         strV = pd->stringByIdx.data();
-         strC = pd->stringByIdx.size();
-      }
-      else
-      {
-         idx = pd->freeIdx.back();
-         pd->freeIdx.pop_back();
+         if(idx >= strC.load(std::memory_order_acquire))
+            grow(idx);
       }
 
       String *str = String::New(data, idx);
-      pd->stringByIdx[idx] = str;
-      pd->stringByData.insert(str);
+      strV.load(std::memory_order_acquire)[idx >> PageBits][idx & PageMask] = str;
+      shard.stringByData.insert(str);
       return *str;
    }
 
@@ -193,15 +245,22 @@ namespace ACSVM
    //
    void StringTable::clear()
    {
-      for(auto &str : pd->stringByIdx)
+      for(auto &shard : pd->shardV)
+         shard.stringByData.clear();
+
+      pd->freeIdx.clear();
+      pd->freeC = 0;
+
+      for(std::size_t idx = 0, end = pd->idxC; idx != end; ++idx)
       {
+         String *str = pd->pageV[idx >> PageBits][idx & PageMask];
          if(str != strNone)
             String::Delete(str);
       }
 
-      pd->freeIdx.clear();
-      pd->stringByData.clear();
-      pd->stringByIdx.clear();
+      pd->pageV.clear();
+      pd->pageListV.clear();
+      pd->idxC = 0;
 
       strV = nullptr;
       strC = 0;
@@ -212,8 +271,11 @@ namespace ACSVM
    //
    void StringTable::collectBegin()
    {
-      for(auto &str : pd->stringByData)
-         str.ref = false;
+      for(auto &shard : pd->shardV)
+      {
+         for(auto &str : shard.stringByData)
+            str.ref = false;
+      }
    }
 
    //
@@ -221,19 +283,67 @@ namespace ACSVM
    //
    void StringTable::collectEnd()
    {
-      for(auto itr = pd->stringByData.begin(), end = pd->stringByData.end(); itr != end;)
+      for(auto &shard : pd->shardV)
       {
-         if(!itr->ref && !itr->lock)
+         auto &map = shard.stringByData;
+         for(auto itr = map.begin(), end = map.end(); itr != end;)
          {
-            String &str = *itr++;
-            pd->stringByIdx[str.idx] = strNone;
-            pd->freeIdx.push_back(str.idx);
-            pd->stringByData.unlink(&str);
-            String::Delete(&str);
+            if(!itr->ref && !itr->lock)
+            {
+               String &str = *itr++;
+               pd->pageV[str.idx >> PageBits][str.idx & PageMask] = strNone;
+               pd->freeIdx.push_back(str.idx);
+               map.unlink(&str);
+               String::Delete(&str);
+            }
+            else
+               ++itr;
          }
-         else
-            ++itr;
       }
+
+      pd->freeC = pd->freeIdx.size();
+
+      // No lookups are in progress, so replaced page lists can be freed.
+      if(pd->pageListV.size() > 1)
+         pd->pageListV.erase(pd->pageListV.begin(), pd->pageListV.end() - 1);
+   }
+
+   //
+   // StringTable::grow
+   //
+   // Adds pages until idx is in range.
+   //
+   void StringTable::grow(Word idx)
+   {
+      std::lock_guard<std::mutex> lock{pd->mutexPage};
+
+      std::size_t pageC = pd->pageV.size();
+
+      // Another thread may have already added the page.
+      if(idx < pageC << PageBits)
+         return;
+
+      // Grow geometrically to limit the number of replaced page lists.
+      std::size_t pageCNew = std::max<std::size_t>((idx >> PageBits) + 1, pageC * 2);
+
+      std::unique_ptr<String **[]> list{new String **[pageCNew]};
+
+      for(std::size_t i = 0; i != pageC; ++i)
+         list[i] = pd->pageV[i].get();
+
+      for(std::size_t i = pageC; i != pageCNew; ++i)
+      {
+         std::unique_ptr<String *[]> page{new String *[PageMask + 1]};
+         std::fill(page.get(), page.get() + PageMask + 1, strNone);
+         list[i] = page.get();
+         pd->pageV.emplace_back(std::move(page));
+      }
+
+      // Publish the list before the count, so readers that see the new count
+      // also see the list.
+      strV.store(list.get(), std::memory_order_release);
+      pd->pageListV.emplace_back(std::move(list));
+      strC.store(pageCNew << PageBits, std::memory_order_release);
    }
 
    //
@@ -253,25 +363,25 @@ namespace ACSVM
 
       auto count = ReadVLN<std::size_t>(in);
 
-      pd->stringByIdx.resize(count);
-      strV = pd->stringByIdx.data();
-      strC = pd->stringByIdx.size();
+      if(count)
+         grow(count - 1);
+      pd->idxC = count;
 
+      String ***pages = strV;
       for(std::size_t idx = 0; idx != count; ++idx)
       {
          if(in.get())
          {
             String *str = String::Read(in, idx);
             str->lock = ReadVLN<std::size_t>(in);
-            pd->stringByIdx[idx] = str;
-            pd->stringByData.insert(str);
+            pages[idx >> PageBits][idx & PageMask] = str;
+            pd->getShard(str->hash).stringByData.insert(str);
          }
          else
-         {
-            pd->stringByIdx[idx] = strNone;
             pd->freeIdx.emplace_back(idx);
-         }
       }
+
+      pd->freeC = pd->freeIdx.size();
    }
 
    //
@@ -279,10 +389,14 @@ namespace ACSVM
    //
    void StringTable::saveState(std::ostream &out) const
    {
-      WriteVLN(out, pd->stringByIdx.size());
+      std::size_t count = pd->idxC;
+
+      WriteVLN(out, count);
 
-      for(String *&str : pd->stringByIdx)
+      for(std::size_t idx = 0; idx != count; ++idx)
       {
+         String *str = pd->pageV[idx >> PageBits][idx & PageMask];
+
          if(str != strNone)
          {
             out << '\1';
@@ -300,7 +414,12 @@ namespace ACSVM
    //
    std::size_t StringTable::size() const
    {
-      return pd->stringByData.size();
+      std::size_t count = 0;
+
+      for(auto &shard : pd->shardV)
+         count += shard.stringByData.size();
+
+      return count;
    }
 
    //
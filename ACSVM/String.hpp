@@ -16,6 +16,7 @@
 #include "List.hpp"
 #include "Types.hpp"
 
+#include <atomic>
 #include <cstring>
 #include <functional>
 #include <memory>
@@ -61,6 +62,9 @@ namespace ACSVM
    class String : public StringData
    {
    public:
+      // Not atomic. Only lockStrings, unlockStrings, refStrings and
+      // collectStrings change lock and ref, so they must not be called by
+      // threads during Environment::execParallel.
       std::size_t lock;
 
       Word const idx;  // Index into table.
@@ -92,6 +96,10 @@ namespace ACSVM
    //
    // StringTable
    //
+   // Strings are kept in shards by hash, each with its own lock, so strings
+   // can be added from several threads at once. Lookup by index takes no lock.
+   // Collection must not happen while strings are being added or looked up.
+   //
    class StringTable
    {
    public:
@@ -100,7 +108,11 @@ namespace ACSVM
       ~StringTable();
 
       String &operator [] (Word idx) const
-         {return idx < strC ? *strV[idx] : *strNone;}
+      {
+         if(idx >= strC.load(std::memory_order_acquire)) return *strNone;
+         return *strV.load(std::memory_order_acquire)[idx >> PageBits][idx & PageMask];
+      }
+
       String &operator [] (StringData const &data);
 
       void clear();
@@ -119,12 +131,20 @@ namespace ACSVM
    private:
       struct PrivData;
 
-      String    **strV;
-      std::size_t strC;
+      void grow(Word idx);
+
+      // Pages of strings by index. Pages are never moved, and replaced page
+      // lists are kept until collection, so readers need no lock.
+      std::atomic<String ***>  strV;
+      std::atomic<std::size_t> strC;
 
       String *strNone;
 
       PrivData *pd;
+
+
+      static constexpr std::size_t PageBits = 10;
+      static constexpr std::size_t PageMask = (1 << PageBits) - 1;
    };
 }
 
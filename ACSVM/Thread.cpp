@@ -15,6 +15,7 @@
 #include "Array.hpp"
 #include "BinaryIO.hpp"
 #include "Environment.hpp"
+#include "Error.hpp"
 #include "Module.hpp"
 #include "Scope.hpp"
 #include "Script.hpp"
@@ -23,6 +24,30 @@
 #include <algorithm>
 
 
+//----------------------------------------------------------------------------|
+// Static Functions                                                           |
+//
+
+namespace ACSVM
+{
+   //
+   // ReadCodePtr
+   //
+   // Code indexes depend on how the module was translated, so a state saved
+   // with different settings may not fit the loaded module.
+   //
+   static Word const *ReadCodePtr(Serial &in, Module *module)
+   {
+      auto idx = ReadVLN<std::size_t>(in);
+
+      if(idx >= module->codeV.size())
+         throw SerialError{"code index out of range"};
+
+      return &module->codeV[idx];
+   }
+}
+
+
 //----------------------------------------------------------------------------|
 // Extern Functions                                                           |
 //
@@ -35,7 +60,8 @@ namespace ACSVM
    Thread::Thread(Environment *env_) :
       env{env_},
 
-      link{this},
+      link    {this},
+      linkExec{this},
 
       codePtr {nullptr},
       module  {nullptr},
@@ -45,7 +71,18 @@ namespace ACSVM
       scopeMod{nullptr},
       script  {nullptr},
       delay   {0},
-      result  {0}
+      result  {0},
+
+      execSeq   {0},
+      execBranch{0},
+      execWake  {0},
+      execWait  {false},
+      execBlock {false},
+      execRun   {false},
+      execSync  {false},
+      execYield {false},
+
+      localArrPos{0}
    {
    }
 
@@ -56,6 +93,58 @@ namespace ACSVM
    {
    }
 
+   //
+   // Thread::allocLocalArr
+   //
+   // Allocates local arrays for a call, using dense storage for those with a
+   // declared size.
+   //
+   void Thread::allocLocalArr(Word count, Vector<Word> const &sizeV)
+   {
+      localArr.alloc(count);
+
+      for(std::size_t i = 0, e = std::min<std::size_t>(count, sizeV.size()); i != e; ++i)
+      {
+         if(sizeV[i] && sizeV[i] <= Array::DenseMax)
+            localArr[i].reserve(sizeV[i], allocLocalArrData(sizeV[i]));
+      }
+   }
+
+   //
+   // Thread::allocLocalArrData
+   //
+   // Takes zeroed storage from localArrBlock. Each block is big enough for
+   // any dense array, so a request that does not fit moves to the next one.
+   //
+   Word *Thread::allocLocalArrData(Word count)
+   {
+      std::size_t idx = localArrPos / LocalArrBlockC;
+      std::size_t off = localArrPos % LocalArrBlockC;
+
+      if(off + count > LocalArrBlockC)
+         ++idx, off = 0;
+
+      if(idx == localArrBlock.size())
+      {
+         std::unique_ptr<Word[]> block{new Word[LocalArrBlockC]};
+         localArrBlock.push_back(std::move(block));
+      }
+
+      Word *data = localArrBlock[idx].get() + off;
+      std::fill(data, data + count, 0);
+
+      localArrPos = idx * LocalArrBlockC + off + count;
+      return data;
+   }
+
+   //
+   // Thread::getDelay
+   //
+   Word Thread::getDelay() const
+   {
+      return execWait ? scopeMap->getThreadDelay(this) : delay;
+   }
+
    //
    // Thread::getInfo
    //
@@ -74,7 +163,7 @@ namespace ACSVM
       in.readSign(Signature::Thread);
 
       module   = env->getModule(env->readModuleName(in));
-      codePtr  = &module->codeV[ReadVLN<std::size_t>(in)];
+      codePtr  = ReadCodePtr(in, module);
       scopeGbl = env->getGlobalScope(ReadVLN<Word>(in));
       scopeHub = scopeGbl->getHubScope(ReadVLN<Word>(in));
       scopeMap = scopeHub->getMapScope(ReadVLN<Word>(in));
@@ -83,19 +172,29 @@ namespace ACSVM
       delay    = ReadVLN<Word>(in);
       result   = ReadVLN<Word>(in);
 
+      // Reserve as in start, beyond the loaded stacks. Calls made with
+      // Call_Bnd rely on this.
+      std::size_t callStkC = CallStkSize, dataStkC = DataStkSize;
+      if(script && script->flagStk)
+      {
+         callStkC += script->callStkC;
+         dataStkC += script->dataStkC;
+      }
+
       count = ReadVLN<std::size_t>(in);
-      callStk.clear(); callStk.reserve(count + CallStkSize);
+      callStk.clear(); callStk.reserve(count + callStkC);
       while(count--)
          callStk.push(readCallFrame(in));
 
       count = ReadVLN<std::size_t>(in);
-      dataStk.clear(); dataStk.reserve(count + DataStkSize);
+      dataStk.clear(); dataStk.reserve(count + dataStkC);
       while(count--)
          dataStk.push(ReadVLN<Word>(in));
 
       countFull = ReadVLN<std::size_t>(in);
       count     = ReadVLN<std::size_t>(in);
       localArr.allocLoad(countFull, count);
+      localArrPos = 0;
       for(auto itr = localArr.beginFull(), end = localArr.end(); itr != end; ++itr)
          itr->loadState(in);
 
@@ -143,10 +242,13 @@ namespace ACSVM
 
       out.module   = env->getModule(env->readModuleName(in));
       out.scopeMod = scopeMap->getModuleScope(out.module);
-      out.codePtr  = &out.module->codeV[ReadVLN<std::size_t>(in)];
+      out.codePtr  = ReadCodePtr(in, out.module);
       out.locArrC  = ReadVLN<std::size_t>(in);
       out.locRegC  = ReadVLN<std::size_t>(in);
 
+      // Loaded local arrays do not use localArrBlock.
+      out.locArrPos = 0;
+
       return out;
    }
 
@@ -168,6 +270,20 @@ namespace ACSVM
          env->getString(state.data)->ref = true;
    }
 
+   //
+   // Thread::reserve
+   //
+   void Thread::reserve()
+   {
+      callStk.reserve(CallStkSize);
+      dataStk.reserve(DataStkSize);
+      printBuf.reserve(PrintBufSize);
+
+      // Store has no reserve, but keeps its storage when cleared.
+      localReg.alloc(env->scriptLocRegC);
+      localReg.clear();
+   }
+
    //
    // Thread::saveState
    //
@@ -181,7 +297,7 @@ namespace ACSVM
       WriteVLN(out, scopeHub->id);
       WriteVLN(out, scopeMap->id);
       env->writeScript(out, script);
-      WriteVLN(out, delay);
+      WriteVLN(out, getDelay());
       WriteVLN(out, result);
 
       WriteVLN(out, callStk.size());
@@ -213,6 +329,29 @@ namespace ACSVM
       out.writeSign(~Signature::Thread);
    }
 
+   //
+   // Thread::setDelay
+   //
+   void Thread::setDelay(Word delay_)
+   {
+      if(execWait || execBlock)
+         scopeMap->wakeThread(this);
+
+      delay = delay_;
+   }
+
+   //
+   // Thread::setState
+   //
+   void Thread::setState(ThreadState const &state_)
+   {
+      // Delayed threads only need waking to be stopped.
+      if(execBlock || (execWait && state_ == ThreadState::Stopped))
+         scopeMap->wakeThread(this);
+
+      state = state_;
+   }
+
    //
    // Thread::start
    //
@@ -230,9 +369,22 @@ namespace ACSVM
       scopeHub = scopeMap->hub;
       scopeGbl = scopeHub->global;
 
-      callStk.reserve(CallStkSize);
-      dataStk.reserve(DataStkSize);
-      localArr.alloc(script->locArrC);
+      map->runThread(this);
+
+      // If the script's stack use is known, reserve it all now, so that calls
+      // within it do not need to grow the stacks. The default sizes are added
+      // in case host functions push more than was traced.
+      if(script->flagStk)
+      {
+         callStk.reserve(script->callStkC + CallStkSize);
+         dataStk.reserve(script->dataStkC + DataStkSize);
+      }
+      else
+      {
+         callStk.reserve(CallStkSize);
+         dataStk.reserve(DataStkSize);
+      }
+      allocLocalArr(script->locArrC, script->locArrSizeV);
       localReg.alloc(script->locRegC);
 
       std::copy(argV, argV + std::min<Word>(argC, script->argC), &localReg[0]);
@@ -254,7 +406,13 @@ namespace ACSVM
       localReg.clear();
       printBuf.clear();
 
-      // Set state.
+      localArrPos = 0;
+
+      // Set state. Waiting threads are returned to the run table, so that
+      // they are freed on the next tic instead of when they would wake.
+      if(execWait || execBlock)
+         scopeMap->wakeThread(this);
+
       state = ThreadState::Inactive;
    }
 
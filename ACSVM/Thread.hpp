@@ -17,6 +17,10 @@
 #include "PrintBuf.hpp"
 #include "Stack.hpp"
 #include "Store.hpp"
+#include "Vector.hpp"
+
+#include <memory>
+#include <vector>
 
 
 //----------------------------------------------------------------------------|
@@ -38,6 +42,7 @@ namespace ACSVM
       ModuleScope *scopeMod;
       std::size_t  locArrC;
       std::size_t  locRegC;
+      std::size_t  locArrPos; // Thread's local array storage in use.
    };
 
    //
@@ -104,6 +109,11 @@ namespace ACSVM
 
       void exec();
 
+      // Returns the remaining execution delay. While waiting for its delay
+      // to end, delay is not updated, so this must be used instead. Outside
+      // of the thread's own execution, delay must only be set by setDelay.
+      Word getDelay() const;
+
       virtual ThreadInfo const *getInfo() const;
 
       virtual void loadState(Serial &in);
@@ -112,8 +122,18 @@ namespace ACSVM
 
       virtual void refStrings() const;
 
+      // Reserves storage for a script with default stack sizes, so that
+      // starting one does not need to allocate.
+      void reserve();
+
       virtual void saveState(Serial &out) const;
 
+      void setDelay(Word delay);
+
+      // Sets the thread's state. Threads waiting on a script or tag are only
+      // checked when woken, so this must be used to change their state.
+      void setState(ThreadState const &state);
+
       virtual void start(Script *script, MapScope *map, ThreadInfo const *info,
          Word const *argV, Word argC);
 
@@ -124,13 +144,14 @@ namespace ACSVM
       Environment *const env;
 
       ListLink<Thread> link;
+      ListLink<Thread> linkExec; // Link in scopeMap's timer or wait lists.
 
       Stack<CallFrame> callStk;
       Stack<Word>      dataStk;
       Store<Array>     localArr;
       Store<Word>      localReg;
       PrintBuf         printBuf;
-      ThreadState      state;
+      ThreadState      state; // Only write from within exec. See setState.
 
       Word  const *codePtr; // Instruction pointer.
       Module      *module;  // Current execution Module.
@@ -139,17 +160,43 @@ namespace ACSVM
       MapScope    *scopeMap;
       ModuleScope *scopeMod;
       Script      *script;  // Current execution Script.
-      Word         delay;   // Execution delay tics.
+      Word         delay;   // Execution delay tics. See getDelay, setDelay.
       Word         result;  // Code-defined thread result.
 
+      DWord        execSeq;    // Execution order within scopeMap.
+      Word         execBranch; // Branches left of branchLimit, if execYield.
+      Word         execWake;   // Tic to wake on, if execWait.
+      bool         execWait;   // Waiting in scopeMap's timer wheel.
+      bool         execBlock;  // Waiting in scopeMap's script or tag lists.
+      bool         execRun;    // In scopeMap's run table.
+      bool         execSync;   // Being started by scriptStartResult.
+      bool         execYield;  // Last exec used up Environment::execBudget.
+
 
-      static constexpr std::size_t CallStkSize =   8;
-      static constexpr std::size_t DataStkSize = 256;
+      // Returns the word that exec dispatches on for code. When dynamic goto
+      // is enabled, this is the offset of the code's handler.
+      static Word ExecCode(Code code);
+
+      static constexpr std::size_t CallStkSize   =   8;
+      static constexpr std::size_t DataStkSize   = 256;
+      static constexpr std::size_t PrintBufSize  =  64;
 
    private:
+      void allocLocalArr(Word count, Vector<Word> const &sizeV);
+
+      Word *allocLocalArrData(Word count);
+
       CallFrame readCallFrame(Serial &in) const;
 
       void writeCallFrame(Serial &out, CallFrame const &in) const;
+
+      // Dense storage for local arrays, kept between calls and scripts. Each
+      // call frame records localArrPos and releases anything past it on
+      // return.
+      std::vector<std::unique_ptr<Word[]>> localArrBlock;
+      std::size_t                          localArrPos;
+
+      static constexpr std::size_t LocalArrBlockC = 8192;
    };
 }
 
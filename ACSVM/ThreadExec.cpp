@@ -16,11 +16,15 @@
 #include "Code.hpp"
 #include "Environment.hpp"
 #include "Function.hpp"
+#include "Jit.hpp"
 #include "Jump.hpp"
 #include "Module.hpp"
+#include "OpFunc.hpp"
 #include "Scope.hpp"
 #include "Script.hpp"
 
+#include <algorithm>
+
 
 //----------------------------------------------------------------------------|
 // Macros                                                                     |
@@ -40,13 +44,26 @@
 #endif
 #endif
 
+//
+// ACSVM_JIT
+//
+// If nonzero, counts calls and backward branches for JitModule. Set by the
+// ACSVM_JIT CMake option.
+//
+#ifndef ACSVM_JIT
+#define ACSVM_JIT 0
+#endif
+
 //
 // BranchTo
 //
 #define BranchTo(target) \
    do \
    { \
-      codePtr = &module->codeV[(target)]; \
+      Word const branchIdx = (target); \
+      if(branchIdx < static_cast<Word>(codePtr - module->codeV.data())) \
+         JitCount(branchIdx); \
+      codePtr = &module->codeV[branchIdx]; \
       CountBranch(); \
    } \
    while(0)
@@ -59,12 +76,19 @@
 #define CountBranch() \
    if(branches && !--branches) \
    { \
-      env->printKill(this, static_cast<Word>(KillType::BranchLimit), 0); \
-      goto thread_stop; \
+      ExecSave(); \
+      goto thread_branch; \
    } \
    else \
       ((void)0)
 
+//
+// CaseAddr
+//
+#if ACSVM_DynamicGoto
+#define CaseAddr(name) static_cast<char const *>(&&case_Code##name)
+#endif
+
 //
 // DeclCase
 //
@@ -74,11 +98,39 @@
 #define DeclCase(name) case static_cast<Word>(Code::name)
 #endif
 
+//
+// ExecLoad
+//
+// Reloads the locally cached execution state from the thread.
+//
+#define ExecLoad() \
+   (codePtr = this->codePtr, dataStk.stkPtr = this->dataStk.end())
+
+//
+// ExecSave
+//
+// Writes the locally cached execution state back to the thread. Must be done
+// before anything outside of Thread::exec can observe or modify it.
+//
+#define ExecSave() \
+   (this->codePtr = codePtr, this->dataStk.setEnd(dataStk.stkPtr))
+
+//
+// JitCount
+//
+// Counts an entry to the code at idx, see JitModule::count.
+//
+#if ACSVM_JIT
+#define JitCount(idx) (module->jit ? module->jit->count(idx) : (void)0)
+#else
+#define JitCount(idx) ((void)0)
+#endif
+
 //
 // NextCase
 //
 #if ACSVM_DynamicGoto
-#define NextCase() goto *cases[*codePtr++]
+#define NextCase() goto *(CaseAddr(Nop) + static_cast<SWord>(*codePtr++))
 #else
 #define NextCase() goto next_case
 #endif
@@ -87,8 +139,8 @@
 // Op_*
 //
 
-#define Op_AddU(lop) (dataStk.drop(), (lop) += dataStk[0])
-#define Op_AndU(lop) (dataStk.drop(), (lop) &= dataStk[0])
+#define Op_AddU(lop) (dataStk.drop(), OpFunc_AddU(lop, dataStk[0]))
+#define Op_AndU(lop) (dataStk.drop(), OpFunc_AndU(lop, dataStk[0]))
 #define Op_CmpI_GE(lop) (dataStk.drop(), OpFunc_CmpI_GE(lop, dataStk[0]))
 #define Op_CmpI_GT(lop) (dataStk.drop(), OpFunc_CmpI_GT(lop, dataStk[0]))
 #define Op_CmpI_LE(lop) (dataStk.drop(), OpFunc_CmpI_LE(lop, dataStk[0]))
@@ -98,18 +150,18 @@
 #define Op_DecU(lop) (--(lop))
 #define Op_DivI(lop) (dataStk.drop(), OpFunc_DivI(lop, dataStk[0]))
 #define Op_DivX(lop) (dataStk.drop(), OpFunc_DivX(lop, dataStk[0]))
-#define Op_Drop(lop) (dataStk.drop(), (lop) = dataStk[0])
+#define Op_Drop(lop) (dataStk.drop(), OpFunc_Drop(lop, dataStk[0]))
 #define Op_IncU(lop) (++(lop))
 #define Op_LAnd(lop) (dataStk.drop(), OpFunc_LAnd(lop, dataStk[0]))
 #define Op_LOrI(lop) (dataStk.drop(), OpFunc_LOrI(lop, dataStk[0]))
 #define Op_ModI(lop) (dataStk.drop(), OpFunc_ModI(lop, dataStk[0]))
-#define Op_MulU(lop) (dataStk.drop(), (lop) *= dataStk[0])
+#define Op_MulU(lop) (dataStk.drop(), OpFunc_MulU(lop, dataStk[0]))
 #define Op_MulX(lop) (dataStk.drop(), OpFunc_MulX(lop, dataStk[0]))
-#define Op_OrIU(lop) (dataStk.drop(), (lop) |= dataStk[0])
-#define Op_OrXU(lop) (dataStk.drop(), (lop) ^= dataStk[0])
-#define Op_ShLU(lop) (dataStk.drop(), (lop) <<= dataStk[0] & 31)
+#define Op_OrIU(lop) (dataStk.drop(), OpFunc_OrIU(lop, dataStk[0]))
+#define Op_OrXU(lop) (dataStk.drop(), OpFunc_OrXU(lop, dataStk[0]))
+#define Op_ShLU(lop) (dataStk.drop(), OpFunc_ShLU(lop, dataStk[0]))
 #define Op_ShRI(lop) (dataStk.drop(), OpFunc_ShRI(lop, dataStk[0]))
-#define Op_SubU(lop) (dataStk.drop(), (lop) -= dataStk[0])
+#define Op_SubU(lop) (dataStk.drop(), OpFunc_SubU(lop, dataStk[0]))
 
 //
 // OpSet
@@ -140,120 +192,144 @@
       Op_##op(*scopeMod->regV[*codePtr++]); \
       NextCase()
 
+//
+// OpSetFused
+//
+// Fused codes read their operands from fixed offsets, skipping over the
+// remainder of the original sequence.
+//
+#define OpSetFused(op) \
+   DeclCase(op##_Lit): \
+      OpFunc_##op(dataStk[1], codePtr[0]); codePtr += 2; \
+      NextCase(); \
+   DeclCase(op##_LocLit): \
+      dataStk.push(localReg[codePtr[0]]); \
+      OpFunc_##op(dataStk[1], codePtr[2]); codePtr += 4; \
+      NextCase(); \
+   DeclCase(op##_LocLoc): \
+      dataStk.push(localReg[codePtr[0]]); \
+      OpFunc_##op(dataStk[1], localReg[codePtr[2]]); codePtr += 4; \
+      NextCase(); \
+   DeclCase(op##_LocLit_Drop): \
+      { \
+         Word lop = localReg[codePtr[0]]; OpFunc_##op(lop, codePtr[2]); \
+         localReg[codePtr[5]] = lop; codePtr += 6; \
+      } \
+      NextCase(); \
+   DeclCase(op##_LocLoc_Drop): \
+      { \
+         Word lop = localReg[codePtr[0]]; OpFunc_##op(lop, localReg[codePtr[2]]); \
+         localReg[codePtr[5]] = lop; codePtr += 6; \
+      } \
+      NextCase()
+
+//
+// OpSetFusedJcmp
+//
+// Compares and branches without pushing the result.
+//
+#define OpSetFusedJcmp(cmp) \
+   DeclCase(Jcmp##cmp): \
+      { \
+         Word lop = dataStk[2]; OpFunc_Cmp##cmp(lop, dataStk[1]); \
+         dataStk.drop(2); \
+         if(lop) BranchTo(codePtr[1]); else codePtr += 2; \
+      } \
+      NextCase(); \
+   DeclCase(Jcmp##cmp##_Lit): \
+      { \
+         Word lop = dataStk[1]; OpFunc_Cmp##cmp(lop, codePtr[0]); \
+         dataStk.drop(); \
+         if(lop) BranchTo(codePtr[3]); else codePtr += 4; \
+      } \
+      NextCase(); \
+   DeclCase(Jcmp##cmp##_LocLit): \
+      { \
+         Word lop = localReg[codePtr[0]]; OpFunc_Cmp##cmp(lop, codePtr[2]); \
+         if(lop) BranchTo(codePtr[5]); else codePtr += 6; \
+      } \
+      NextCase(); \
+   DeclCase(Jcmp##cmp##_LocLoc): \
+      { \
+         Word lop = localReg[codePtr[0]]; OpFunc_Cmp##cmp(lop, localReg[codePtr[2]]); \
+         if(lop) BranchTo(codePtr[5]); else codePtr += 6; \
+      } \
+      NextCase()
+
+//
+// OpSetFusedLocReg
+//
+#define OpSetFusedLocReg(op) \
+   DeclCase(op##_LocReg_Lit): \
+      OpFunc_##op(localReg[codePtr[2]], codePtr[0]); codePtr += 3; \
+      NextCase(); \
+   DeclCase(op##_LocReg_Loc): \
+      OpFunc_##op(localReg[codePtr[2]], localReg[codePtr[0]]); codePtr += 3; \
+      NextCase()
+
 
 //----------------------------------------------------------------------------|
-// Static Functions                                                           |
+// Types                                                                      |
 //
 
 namespace ACSVM
 {
    //
-   // OpFunc_CmpI_GE
-   //
-   static inline void OpFunc_CmpI_GE(Word &lop, Word rop)
-   {
-      lop = static_cast<SWord>(lop) >= static_cast<SWord>(rop);
-   }
-
+   // ExecStack
    //
-   // OpFunc_CmpI_GT
+   // Stands in for Thread::dataStk during Thread::exec so that the stack
+   // pointer can be kept in a register instead of being loaded and stored
+   // through the thread for every code.
    //
-   static inline void OpFunc_CmpI_GT(Word &lop, Word rop)
+   class ExecStack
    {
-      lop = static_cast<SWord>(lop) > static_cast<SWord>(rop);
-   }
+   public:
+      Word &operator [] (std::size_t idx) {return *(stkPtr - idx);}
 
-   //
-   // OpFunc_CmpI_LE
-   //
-   static inline void OpFunc_CmpI_LE(Word &lop, Word rop)
-   {
-      lop = static_cast<SWord>(lop) <= static_cast<SWord>(rop);
-   }
+      void drop() {--stkPtr;}
+      void drop(std::size_t n) {stkPtr -= n;}
 
-   //
-   // OpFunc_CmpI_LT
-   //
-   static inline void OpFunc_CmpI_LT(Word &lop, Word rop)
-   {
-      lop = static_cast<SWord>(lop) < static_cast<SWord>(rop);
-   }
+      void push(Word value) {*stkPtr++ = value;}
 
-   //
-   // OpFunc_CmpU_EQ
-   //
-   static inline void OpFunc_CmpU_EQ(Word &lop, Word rop)
-   {
-      lop = lop == rop;
-   }
+      Word *stkPtr;
+   };
+}
 
-   //
-   // OpFunc_CmpU_NE
-   //
-   static inline void OpFunc_CmpU_NE(Word &lop, Word rop)
-   {
-      lop = lop != rop;
-   }
 
-   //
-   // OpFunc_DivI
-   //
-   static inline void OpFunc_DivI(Word &lop, Word rop)
-   {
-      lop = rop ? static_cast<SWord>(lop) / static_cast<SWord>(rop) : 0;
-   }
+//----------------------------------------------------------------------------|
+// Static Objects                                                             |
+//
 
-   //
-   // OpFunc_DivX
-   //
-   static inline void OpFunc_DivX(Word &lop, Word rop)
-   {
-      if(rop)
-         lop = (SDWord(SWord(lop)) << 16) / SWord(rop);
-      else
-         lop = 0;
-   }
+namespace ACSVM
+{
+   #if ACSVM_DynamicGoto
+   // Handler offsets from Thread::exec, indexed by Code. See ExecCaseInit.
+   static SWord const *ExecCaseV = nullptr;
+   #endif
+}
 
-   //
-   // OpFunc_LAnd
-   //
-   static inline void OpFunc_LAnd(Word &lop, Word rop)
-   {
-      lop = lop && rop;
-   }
 
-   //
-   // OpFunc_LOrI
-   //
-   static inline void OpFunc_LOrI(Word &lop, Word rop)
-   {
-      lop = lop || rop;
-   }
+//----------------------------------------------------------------------------|
+// Static Functions                                                           |
+//
 
+namespace ACSVM
+{
+   #if ACSVM_DynamicGoto
    //
-   // OpFunc_ModI
-   //
-   static inline void OpFunc_ModI(Word &lop, Word rop)
-   {
-      lop = rop ? static_cast<SWord>(lop) % static_cast<SWord>(rop) : 0;
-   }
-
+   // ExecCaseInit
    //
-   // OpFunc_MulX
+   // Runs Thread::exec on a Thread with no Environment, which only sets
+   // ExecCaseV.
    //
-   static inline void OpFunc_MulX(Word &lop, Word rop)
+   static bool ExecCaseInit()
    {
-      lop = DWord(SDWord(SWord(lop)) * SWord(rop)) >> 16;
-   }
+      Thread thread{nullptr};
+      thread.exec();
 
-   //
-   // OpFunc_ShRI
-   //
-   static inline void OpFunc_ShRI(Word &lop, Word rop)
-   {
-      // TODO: Implement this without relying on sign-extending shift.
-      lop = static_cast<SWord>(lop) >> (rop & 31);
+      return ExecCaseV != nullptr;
    }
+   #endif
 }
 
 
@@ -268,15 +344,53 @@ namespace ACSVM
    //
    void Thread::exec()
    {
+      #if ACSVM_DynamicGoto
+      static SWord const cases[] =
+      {
+         #define ACSVM_CodeList(name, ...) \
+            static_cast<SWord>(CaseAddr(name) - CaseAddr(Nop)),
+         #include "CodeList.hpp"
+      };
+
+      #endif
+
       if(delay && --delay)
          return;
 
-      auto branches = env->branchLimit;
+      // Checked before env is used, for ExecCaseInit.
+      if(state == ThreadState::Inactive)
+      {
+         #if ACSVM_DynamicGoto
+         if(!env) ExecCaseV = cases;
+         #endif
+         return;
+      }
+
+      // If execBudget is less than the branches left of branchLimit, the
+      // thread is suspended when it runs out of branches instead of being
+      // killed. Branches made before being suspended still count toward
+      // branchLimit, until the thread delays or waits.
+      Word limit    = execYield ? execBranch : env->branchLimit;
+      Word branches = limit;
+      bool yield    = env->execBudget && (!limit || env->execBudget < limit);
+      if(yield) branches = env->execBudget;
+
+      Word budget = branches;
+
+      execYield = false;
+
+      // Cached copies of the instruction pointer and data stack. These
+      // intentionally shadow the members, see ExecLoad and ExecSave.
+      Word const *codePtr = this->codePtr;
+      ExecStack   dataStk{this->dataStk.end()};
 
    exec_intr:
+      ExecSave();
+
       switch(state.state)
       {
       case ThreadState::Inactive: return;
+
       case ThreadState::Stopped:  goto thread_stop;
       case ThreadState::Paused:   return;
 
@@ -304,14 +418,6 @@ namespace ACSVM
          break;
       }
 
-      #if ACSVM_DynamicGoto
-      static void const *const cases[] =
-      {
-         #define ACSVM_CodeList(name, ...) &&case_Code##name,
-         #include "CodeList.hpp"
-      };
-      #endif
-
       #if ACSVM_DynamicGoto
       NextCase();
       #else
@@ -322,6 +428,7 @@ namespace ACSVM
          NextCase();
 
       DeclCase(Kill):
+         ExecSave();
          module->env->printKill(this, codePtr[0], codePtr[1]);
          goto thread_stop;
 
@@ -365,28 +472,47 @@ namespace ACSVM
          // Call codes.
          //
 
-      DeclCase(Call_Lit):
+      DeclCase(Call_Bnd):
          {
             Function *func;
 
+            // Stack space for the call was reserved along with the caller's.
+            func = module->functionV[*codePtr++];
+            goto do_call_bnd;
+
+      DeclCase(Call_Lit):
             func = *codePtr < module->functionV.size() ? module->functionV[*codePtr] : nullptr;
             ++codePtr;
 
          do_call:
             if(!func) {BranchTo(0); NextCase();}
 
-            // Reserve stack space.
-            callStk.reserve(CallStkSize);
-            dataStk.reserve(DataStkSize);
-
+            // Reserve stack space. If the function's stack use is known,
+            // reserve enough for everything it calls, too, plus the default
+            // size for anything the trace could not see.
+            ExecSave();
+            if(func->flagStk)
+            {
+               callStk.reserve(func->callStkC + 1 + CallStkSize);
+               this->dataStk.reserve(func->dataStkC + DataStkSize);
+            }
+            else
+            {
+               callStk.reserve(CallStkSize);
+               this->dataStk.reserve(DataStkSize);
+            }
+            ExecLoad();
+
+         do_call_bnd:
             // Push call frame.
-            callStk.push({codePtr, module, scopeMod, localArr.size(), localReg.size()});
+            callStk.push({codePtr, module, scopeMod, localArr.size(), localReg.size(), localArrPos});
 
             // Apply function data.
             codePtr      = &func->module->codeV[func->codeIdx];
             module       = func->module;
             scopeMod     = scopeMap->getModuleScope(module);
-            localArr.alloc(func->locArrC);
+            JitCount(func->codeIdx);
+            allocLocalArr(func->locArrC, func->locArrSizeV);
             localReg.alloc(func->locRegC);
 
             // Read arguments.
@@ -406,7 +532,10 @@ namespace ACSVM
             Word argc = *codePtr++;
             Word func = *codePtr++;
             dataStk.drop(argc);
-            if(env->callFunc(this, func, &dataStk[0], argc))
+            ExecSave();
+            bool intr = env->callFunc(this, func, &dataStk[0], argc);
+            ExecLoad();
+            if(intr)
                goto exec_intr;
          }
          NextCase();
@@ -417,7 +546,10 @@ namespace ACSVM
             Word        func = *codePtr++;
             Word const *argv =  codePtr;
             codePtr += argc;
-            if(env->callFunc(this, func, argv, argc))
+            ExecSave();
+            bool intr = env->callFunc(this, func, argv, argc);
+            ExecLoad();
+            if(intr)
                goto exec_intr;
          }
          NextCase();
@@ -427,7 +559,9 @@ namespace ACSVM
             Word argc = *codePtr++;
             Word spec = *codePtr++;
             dataStk.drop(argc);
+            ExecSave();
             env->callSpec(this, spec, &dataStk[0], argc);
+            ExecLoad();
          }
          NextCase();
 
@@ -437,7 +571,9 @@ namespace ACSVM
             Word        spec = *codePtr++;
             Word const *argv =  codePtr;
             codePtr += argc;
+            ExecSave();
             env->callSpec(this, spec, argv, argc);
+            ExecLoad();
          }
          NextCase();
 
@@ -446,7 +582,10 @@ namespace ACSVM
             Word argc = *codePtr++;
             Word spec = *codePtr++;
             dataStk.drop(argc);
-            dataStk.push(env->callSpec(this, spec, &dataStk[0], argc));
+            ExecSave();
+            Word ret = env->callSpec(this, spec, &dataStk[0], argc);
+            ExecLoad();
+            dataStk.push(ret);
          }
          NextCase();
 
@@ -461,6 +600,7 @@ namespace ACSVM
          scopeMod    = callStk[1].scopeMod;
          localArr.free(callStk[1].locArrC);
          localReg.free(callStk[1].locRegC);
+         localArrPos = callStk[1].locArrPos;
 
          // Drop call frame.
          callStk.drop();
@@ -504,7 +644,7 @@ namespace ACSVM
          NextCase();
 
       DeclCase(Jcnd_Tab):
-         if(auto jump = module->jumpMapV[*codePtr++].table.find(dataStk[1]))
+         if(auto jump = module->jumpMapV[*codePtr++].find(dataStk[1]))
          {
             dataStk.drop();
             BranchTo(*jump);
@@ -632,11 +772,66 @@ namespace ACSVM
       DeclCase(NotU):
          dataStk[1] = !dataStk[1];
          NextCase();
+
+         //================================================
+         // Fused codes.
+         //
+
+         #define ACSVM_CodeListFusedOp(name) OpSetFused(name);
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedOpSet(name) OpSetFusedLocReg(name);
+         #include "CodeList.hpp"
+
+         #define ACSVM_CodeListFusedJcmp(name, inv) OpSetFusedJcmp(name);
+         #include "CodeList.hpp"
+
+         //================================================
+         // Native code.
+         //
+
+      DeclCase(Native):
+         {
+            // The native code starts from the replaced code.
+            --codePtr;
+            ExecSave();
+            bool cont = module->native(this, branches);
+            ExecLoad();
+            if(!cont)
+               goto thread_branch;
+         }
+         NextCase();
+      }
+
+   thread_branch:
+      // Suspended threads resume from the saved codePtr on the next exec.
+      if(yield)
+      {
+         execBranch = limit ? limit - budget : 0;
+         execYield  = true;
+         return;
       }
 
+      env->printKill(this, static_cast<Word>(KillType::BranchLimit), 0);
+
    thread_stop:
+      ExecSave();
       stop();
    }
+
+   //
+   // Thread::ExecCode
+   //
+   Word Thread::ExecCode(Code code)
+   {
+      #if ACSVM_DynamicGoto
+      static bool const init = ExecCaseInit();
+
+      return init ? ExecCaseV[static_cast<Word>(code)] : 0;
+      #else
+      return static_cast<Word>(code);
+      #endif
+   }
 }
 
 // EOF
@@ -56,6 +56,7 @@ namespace ACSVM
    class Function;
    class GlobalScope;
    class HubScope;
+   class JitModule;
    class Jump;
    class JumpMap;
    class MapScope;
@@ -75,6 +76,7 @@ namespace ACSVM
    class WordInit;
 
    using CallFunc = bool (*)(Thread *thread, Word const *argv, Word argc);
+   using NativeFunc = bool (*)(Thread *thread, Word &branches);
 }
 
 #endif//ACSVM__Types_H__
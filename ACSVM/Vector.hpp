@@ -56,7 +56,8 @@ namespace ACSVM
 
       ~Vector() {free();}
 
-      T &operator [] (size_type i) {return dataV[i];}
+      T       &operator [] (size_type i)       {return dataV[i];}
+      T const &operator [] (size_type i) const {return dataV[i];}
 
       Vector<T> &operator = (Vector<T> &&v) {swap(v); return *this;}
 
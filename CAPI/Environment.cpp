@@ -16,10 +16,37 @@
 #include "Module.h"
 #include "Thread.h"
 
+#include "ACSVM/Action.hpp"
 #include "ACSVM/CodeData.hpp"
 #include "ACSVM/Error.hpp"
 #include "ACSVM/Serial.hpp"
 
+#include <algorithm>
+
+
+//----------------------------------------------------------------------------|
+// Static Functions                                                           |
+//
+
+//
+// QueueScript
+//
+static bool QueueScript(ACSVM_Environment *env, ACSVM_ScriptName name_,
+   ACSVM_ScopeID id, ACSVM::ScriptAction::Action action,
+   ACSVM_Word const *argV, ACSVM_Word argC)
+{
+   try
+   {
+      ACSVM::ScriptName name{reinterpret_cast<ACSVM::String *>(name_.s), name_.i};
+      env->queueAction({{id.global, id.hub, id.map}, name, action, {argV, argC}});
+      return true;
+   }
+   catch(std::bad_alloc const &)
+   {
+      return false;
+   }
+}
+
 
 extern "C"
 {
@@ -120,6 +147,17 @@ ACSVM::ModuleName ACSVM_Environment::getModuleName(char const *str, std::size_t
    return {reinterpret_cast<ACSVM::String *>(name.s), name.p, name.i};
 }
 
+//
+// ACSVM_Environment::getScriptPriority
+//
+ACSVM::Word ACSVM_Environment::getScriptPriority(ACSVM::Word type)
+{
+   if(!funcs.getScriptPriority)
+      return ACSVM::Environment::getScriptPriority(type);
+
+   return funcs.getScriptPriority(this, type);
+}
+
 //
 // ACSVM_Environment::loadModule
 //
@@ -320,6 +358,42 @@ void ACSVM_Environment_Exec(ACSVM_Environment *env)
    }
 }
 
+//
+// ACSVM_Environment_ExecFor
+//
+bool ACSVM_Environment_ExecFor(ACSVM_Environment *env, ACSVM_DWord budget)
+{
+   auto ns = std::min<ACSVM_DWord>(budget, std::chrono::nanoseconds::max().count());
+
+   try
+   {
+      return env->execFor(std::chrono::nanoseconds(ns));
+   }
+   catch(std::bad_alloc const &e)
+   {
+      if(env->funcs.bad_alloc)
+         env->funcs.bad_alloc(env, e.what());
+
+      return false;
+   }
+}
+
+//
+// ACSVM_Environment_ExecParallel
+//
+void ACSVM_Environment_ExecParallel(ACSVM_Environment *env, unsigned workers)
+{
+   try
+   {
+      env->execParallel(workers);
+   }
+   catch(std::bad_alloc const &e)
+   {
+      if(env->funcs.bad_alloc)
+         env->funcs.bad_alloc(env, e.what());
+   }
+}
+
 //
 // ACSVM_Environment_FreeGlobalScope
 //
@@ -344,6 +418,22 @@ ACSVM_Word ACSVM_Environment_GetBranchLimit(ACSVM_Environment const *env)
    return env->branchLimit;
 }
 
+//
+// ACSVM_Environment_GetCodeFuse
+//
+bool ACSVM_Environment_GetCodeFuse(ACSVM_Environment const *env)
+{
+   return env->codeFuse;
+}
+
+//
+// ACSVM_Environment_GetCodePeephole
+//
+bool ACSVM_Environment_GetCodePeephole(ACSVM_Environment const *env)
+{
+   return env->codePeephole;
+}
+
 //
 // ACSVM_Environment_GetData
 //
@@ -352,6 +442,14 @@ void *ACSVM_Environment_GetData(ACSVM_Environment const *env)
    return env->data;
 }
 
+//
+// ACSVM_Environment_GetExecBudget
+//
+ACSVM_Word ACSVM_Environment_GetExecBudget(ACSVM_Environment const *env)
+{
+   return env->execBudget;
+}
+
 //
 // ACSVM_Environment_GetGlobalScope
 //
@@ -412,6 +510,14 @@ ACSVM_StringTable *ACSVM_Environment_GetStringTable(ACSVM_Environment *env)
    return reinterpret_cast<ACSVM_StringTable *>(&env->stringTable);
 }
 
+//
+// ACSVM_Environment_GetTagNotify
+//
+bool ACSVM_Environment_GetTagNotify(ACSVM_Environment const *env)
+{
+   return env->tagNotify;
+}
+
 //
 // ACSVM_Environment_HasActiveThread
 //
@@ -446,6 +552,73 @@ bool ACSVM_Environment_LoadState(ACSVM_Environment *env, ACSVM_Serial *in)
    }
 }
 
+//
+// ACSVM_Environment_NotifyTag
+//
+void ACSVM_Environment_NotifyTag(ACSVM_Environment *env, ACSVM_Word type, ACSVM_Word tag)
+{
+   env->notifyTag(type, tag);
+}
+
+//
+// ACSVM_Environment_QueueScriptPause
+//
+bool ACSVM_Environment_QueueScriptPause(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id)
+{
+   return QueueScript(env, name, id,
+      ACSVM::ScriptAction::Pause, nullptr, 0);
+}
+
+//
+// ACSVM_Environment_QueueScriptStart
+//
+bool ACSVM_Environment_QueueScriptStart(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id, ACSVM_Word const *argV, ACSVM_Word argC)
+{
+   return QueueScript(env, name, id,
+      ACSVM::ScriptAction::Start, argV, argC);
+}
+
+//
+// ACSVM_Environment_QueueScriptStartForced
+//
+bool ACSVM_Environment_QueueScriptStartForced(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id, ACSVM_Word const *argV, ACSVM_Word argC)
+{
+   return QueueScript(env, name, id,
+      ACSVM::ScriptAction::StartForced, argV, argC);
+}
+
+//
+// ACSVM_Environment_QueueScriptStop
+//
+bool ACSVM_Environment_QueueScriptStop(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id)
+{
+   return QueueScript(env, name, id,
+      ACSVM::ScriptAction::Stop, nullptr, 0);
+}
+
+//
+// ACSVM_Environment_ReserveThreads
+//
+bool ACSVM_Environment_ReserveThreads(ACSVM_Environment *env, size_t count)
+{
+   try
+   {
+      env->reserveThreads(count);
+      return true;
+   }
+   catch(std::bad_alloc const &e)
+   {
+      if(env->funcs.bad_alloc)
+         env->funcs.bad_alloc(env, e.what());
+
+      return false;
+   }
+}
+
 //
 // ACSVM_Environment_SaveState
 //
@@ -462,6 +635,22 @@ void ACSVM_Environment_SetBranchLimit(ACSVM_Environment *env, ACSVM_Word branchL
    env->branchLimit = branchLimit;
 }
 
+//
+// ACSVM_Environment_SetCodeFuse
+//
+void ACSVM_Environment_SetCodeFuse(ACSVM_Environment *env, bool codeFuse)
+{
+   env->codeFuse = codeFuse;
+}
+
+//
+// ACSVM_Environment_SetCodePeephole
+//
+void ACSVM_Environment_SetCodePeephole(ACSVM_Environment *env, bool codePeephole)
+{
+   env->codePeephole = codePeephole;
+}
+
 //
 // ACSVM_Environment_SetData
 //
@@ -470,6 +659,14 @@ void ACSVM_Environment_SetData(ACSVM_Environment *env, void *data)
    env->data = data;
 }
 
+//
+// ACSVM_Environment_SetExecBudget
+//
+void ACSVM_Environment_SetExecBudget(ACSVM_Environment *env, ACSVM_Word execBudget)
+{
+   env->execBudget = execBudget;
+}
+
 //
 // ACSVM_Environment_SetScriptLocRegC
 //
@@ -478,6 +675,14 @@ void ACSVM_Environment_SetScriptLocReg(ACSVM_Environment *env, ACSVM_Word script
    env->scriptLocRegC = scriptLocRegC;
 }
 
+//
+// ACSVM_Environment_SetTagNotify
+//
+void ACSVM_Environment_SetTagNotify(ACSVM_Environment *env, bool tagNotify)
+{
+   env->tagNotify = tagNotify;
+}
+
 }
 
 // EOF
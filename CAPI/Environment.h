@@ -14,6 +14,8 @@
 #define ACSVM__CAPI__Environment_H__
 
 #include "Code.h"
+#include "Scope.h"
+#include "Script.h"
 
 #ifdef __cplusplus
 #include "../ACSVM/Environment.hpp"
@@ -97,6 +99,12 @@ typedef struct ACSVM_EnvironmentFuncs
 
    // Return false if load fails.
    bool (*loadModule)(ACSVM_Environment *env, ACSVM_Module *module);
+
+   // Later additions, kept after the above to preserve their layout.
+
+   // public
+
+   ACSVM_Word (*getScriptPriority)(ACSVM_Environment *env, ACSVM_Word type);
 } ACSVM_EnvironmentFuncs;
 
 #ifdef __cplusplus
@@ -118,6 +126,8 @@ public:
 
    virtual ACSVM::ModuleName getModuleName(char const *str, size_t len);
 
+   virtual ACSVM::Word getScriptPriority(ACSVM::Word type);
+
    virtual void loadState(ACSVM::Serial &in);
 
    virtual void printArray(ACSVM::PrintBuf &buf, ACSVM::Array const &array,
@@ -170,25 +180,54 @@ void ACSVM_Environment_CollectStrings(ACSVM_Environment *env);
 
 void ACSVM_Environment_Exec(ACSVM_Environment *env);
 
+// Budget is in nanoseconds. Returns true if the tic was finished.
+bool ACSVM_Environment_ExecFor(ACSVM_Environment *env, ACSVM_DWord budget);
+
+void ACSVM_Environment_ExecParallel(ACSVM_Environment *env, unsigned workers);
+
 void ACSVM_Environment_FreeGlobalScope(ACSVM_Environment *env, ACSVM_GlobalScope *scope);
 void ACSVM_Environment_FreeModule(ACSVM_Environment *env, ACSVM_Module *module);
 
 ACSVM_Word         ACSVM_Environment_GetBranchLimit(ACSVM_Environment const *env);
+bool               ACSVM_Environment_GetCodeFuse(ACSVM_Environment const *env);
+bool               ACSVM_Environment_GetCodePeephole(ACSVM_Environment const *env);
 void              *ACSVM_Environment_GetData(ACSVM_Environment const *env);
+ACSVM_Word         ACSVM_Environment_GetExecBudget(ACSVM_Environment const *env);
 ACSVM_GlobalScope *ACSVM_Environment_GetGlobalScope(ACSVM_Environment *env, ACSVM_Word id);
 ACSVM_Module      *ACSVM_Environment_GetModule(ACSVM_Environment *env, ACSVM_ModuleName name);
 ACSVM_Word         ACSVM_Environment_GetScriptLocRegC(ACSVM_Environment const *env);
 ACSVM_StringTable *ACSVM_Environment_GetStringTable(ACSVM_Environment *env);
+bool               ACSVM_Environment_GetTagNotify(ACSVM_Environment const *env);
 
 bool ACSVM_Environment_HasActiveThread(ACSVM_Environment const *env);
 
 bool ACSVM_Environment_LoadState(ACSVM_Environment *env, ACSVM_Serial *in);
 
+void ACSVM_Environment_NotifyTag(ACSVM_Environment *env, ACSVM_Word type, ACSVM_Word tag);
+
+// Wrappers around Environment::queueAction, which may be called from any
+// thread. Return false if allocation fails.
+bool ACSVM_Environment_QueueScriptPause(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id);
+bool ACSVM_Environment_QueueScriptStart(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id, ACSVM_Word const *argV, ACSVM_Word argC);
+bool ACSVM_Environment_QueueScriptStartForced(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id, ACSVM_Word const *argV, ACSVM_Word argC);
+bool ACSVM_Environment_QueueScriptStop(ACSVM_Environment *env,
+   ACSVM_ScriptName name, ACSVM_ScopeID id);
+
+// Returns false if allocation fails.
+bool ACSVM_Environment_ReserveThreads(ACSVM_Environment *env, size_t count);
+
 void ACSVM_Environment_SaveState(ACSVM_Environment *env, ACSVM_Serial *out);
 
 void ACSVM_Environment_SetBranchLimit(ACSVM_Environment *env, ACSVM_Word branchLimit);
+void ACSVM_Environment_SetCodeFuse(ACSVM_Environment *env, bool codeFuse);
+void ACSVM_Environment_SetCodePeephole(ACSVM_Environment *env, bool codePeephole);
 void ACSVM_Environment_SetData(ACSVM_Environment *env, void *data);
+void ACSVM_Environment_SetExecBudget(ACSVM_Environment *env, ACSVM_Word execBudget);
 void ACSVM_Environment_SetScriptLocRegC(ACSVM_Environment *env, ACSVM_Word scriptLocRegC);
+void ACSVM_Environment_SetTagNotify(ACSVM_Environment *env, bool tagNotify);
 
 #ifdef __cplusplus
 }
@@ -193,7 +193,7 @@ ACSVM_Word const *ACSVM_Thread_GetCodePtr(ACSVM_Thread const *thread)
 //
 ACSVM_Word ACSVM_Thread_GetDelay(ACSVM_Thread const *thread)
 {
-   return thread->delay;
+   return thread->getDelay();
 }
 
 //
@@ -331,7 +331,7 @@ void ACSVM_Thread_SetCodePtr(ACSVM_Thread *thread, ACSVM_Word const *codePtr)
 //
 void ACSVM_Thread_SetDelay(ACSVM_Thread *thread, ACSVM_Word delay)
 {
-   thread->delay = delay;
+   thread->setDelay(delay);
 }
 
 //
@@ -355,8 +355,8 @@ void ACSVM_Thread_SetResult(ACSVM_Thread *thread, ACSVM_Word result)
 //
 void ACSVM_Thread_SetState(ACSVM_Thread *thread, ACSVM_ThreadState state)
 {
-   thread->state =
-      {static_cast<ACSVM::ThreadState::State>(state.state), state.data, state.type};
+   thread->setState(
+      {static_cast<ACSVM::ThreadState::State>(state.state), state.data, state.type});
 }
 
 }
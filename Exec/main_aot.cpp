@@ -0,0 +1,131 @@
+//----------------------------------------------------------------------------
+//
+// Copyright (C) 2015-2017 David Hill
+//
+// See COPYING for license information.
+//
+//----------------------------------------------------------------------------
+//
+// Program entry point for acsvm-aot.
+//
+// Writes C++ source for the code of each module given on the command line.
+// Compiling the output with a host and calling ACSVM_NativeRegister on its
+// Environment before loading modules lets matching modules run as native code.
+// Modules only match if the host translates them identically, which requires
+// the same code and function data as the Environment used here.
+//
+//----------------------------------------------------------------------------
+
+#include "ACSVM/Environment.hpp"
+#include "ACSVM/Error.hpp"
+#include "ACSVM/Module.hpp"
+#include "ACSVM/Native.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+//----------------------------------------------------------------------------|
+// Types                                                                      |
+//
+
+//
+// Environment
+//
+class Environment : public ACSVM::Environment
+{
+protected:
+   virtual void loadModule(ACSVM::Module *module);
+};
+
+
+//----------------------------------------------------------------------------|
+// Extern Functions                                                           |
+//
+
+//
+// Environment::loadModule
+//
+void Environment::loadModule(ACSVM::Module *module)
+{
+   std::ifstream in{module->name.s->str, std::ios_base::in | std::ios_base::binary};
+
+   if(!in) throw ACSVM::ReadError("file open failure");
+
+   std::vector<ACSVM::Byte> data;
+
+   for(int c; c = in.get(), in;)
+      data.push_back(c);
+
+   module->readBytecode(data.data(), data.size());
+}
+
+//
+// main
+//
+int main(int argc, char *argv[])
+{
+   if(argc < 2)
+   {
+      std::cerr << "Usage: " << argv[0] << " module... > native.cpp" << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   Environment env;
+
+   // Load modules.
+   std::vector<ACSVM::Module *> modules;
+   try
+   {
+      for(int i = 1; i < argc; ++i)
+         modules.push_back(env.getModule(env.getModuleName(argv[i])));
+   }
+   catch(ACSVM::ReadError &e)
+   {
+      std::cerr << "Error loading modules: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::cout <<
+      "//\n"
+      "// Generated by acsvm-aot.\n"
+      "//\n\n"
+      "#include \"ACSVM/Array.hpp\"\n"
+      "#include \"ACSVM/Environment.hpp\"\n"
+      "#include \"ACSVM/Function.hpp\"\n"
+      "#include \"ACSVM/Jump.hpp\"\n"
+      "#include \"ACSVM/Module.hpp\"\n"
+      "#include \"ACSVM/OpFunc.hpp\"\n"
+      "#include \"ACSVM/Scope.hpp\"\n"
+      "#include \"ACSVM/String.hpp\"\n"
+      "#include \"ACSVM/Thread.hpp\"\n\n"
+      "#include <utility>\n\n\n";
+
+   // Write native code.
+   for(std::size_t i = 0; i != modules.size(); ++i)
+      ACSVM::WriteNative(std::cout, modules[i], ("Native_" + std::to_string(i)).c_str());
+
+   // Write registration function.
+   std::cout <<
+      "//\n"
+      "// ACSVM_NativeRegister\n"
+      "//\n"
+      "extern \"C\" void ACSVM_NativeRegister(ACSVM::Environment *env)\n"
+      "{\n";
+
+   for(std::size_t i = 0; i != modules.size(); ++i)
+   {
+      std::cout << "   env->addNative(Native_" << i << "_Code, "
+         << modules[i]->codeV.size() << ", " << modules[i]->codeHash
+         << "u, Native_" << i << ");\n";
+   }
+
+   std::cout << "}\n\n// EOF\n\n";
+
+   return EXIT_SUCCESS;
+}
+
+// EOF
+
@@ -23,6 +23,7 @@
 #include "Util/Floats.hpp"
 
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -133,12 +134,14 @@ static bool CF_Timer(ACSVM::Thread *thread, ACSVM::Word const *, ACSVM::Word)
 //
 // LoadModules
 //
+// Arguments starting with - are options, handled by SetOptions.
+//
 static void LoadModules(Environment &env, char const *const *argv, std::size_t argc)
 {
    // Load modules.
    std::vector<ACSVM::Module *> modules;
    for(std::size_t i = 1; i < argc; ++i)
-      modules.push_back(env.getModule(env.getModuleName(argv[i])));
+      if(argv[i][0] != '-') modules.push_back(env.getModule(env.getModuleName(argv[i])));
 
    // Create and activate scopes.
    ACSVM::GlobalScope *global = env.getGlobalScope(0);  global->active = true;
@@ -153,6 +156,25 @@ static void LoadModules(Environment &env, char const *const *argv, std::size_t a
 }
 
 
+//
+// SetOptions
+//
+// Options affect how modules are loaded, so must be set before LoadModules.
+//
+static void SetOptions(Environment &env, char const *const *argv, std::size_t argc)
+{
+   for(std::size_t i = 1; i < argc; ++i)
+   {
+      if(!std::strcmp(argv[i], "--no-fuse"))
+         env.codeFuse = false;
+      else if(!std::strcmp(argv[i], "--peephole"))
+         env.codePeephole = true;
+      else if(argv[i][0] == '-')
+         std::cerr << "Unknown option: " << argv[i] << std::endl;
+   }
+}
+
+
 //----------------------------------------------------------------------------|
 // Extern Functions                                                           |
 //
@@ -215,6 +237,8 @@ int main(int argc, char *argv[])
 {
    Environment env;
 
+   SetOptions(env, argv, argc);
+
    // Load modules.
    try
    {
@@ -0,0 +1,34 @@
+##-----------------------------------------------------------------------------
+##
+## Copyright (C) 2017 David Hill
+##
+## See COPYING for license information.
+##
+##-----------------------------------------------------------------------------
+##
+## Runs acsvm-exec on a module and compares its output to a file.
+##
+## Expects EXEC, OPTIONS, MODULE and EXPECT to be set with -D.
+##
+##-----------------------------------------------------------------------------
+
+separate_arguments(OPTIONS)
+
+execute_process(
+   COMMAND ${EXEC} ${OPTIONS} ${MODULE}
+   OUTPUT_VARIABLE output
+   RESULT_VARIABLE result
+)
+
+if(NOT result EQUAL 0)
+   message(FATAL_ERROR "acsvm-exec failed: ${result}")
+endif()
+
+file(READ ${EXPECT} expect)
+
+if(NOT output STREQUAL expect)
+   message(FATAL_ERROR "Output differs from ${EXPECT}:\n${output}")
+endif()
+
+## EOF
+